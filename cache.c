@@ -0,0 +1,438 @@
+/*  File name: cache.c
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "exec.h"
+#include "myshell.h"
+
+/*
+ * Layout of a cache file. Every field is native-endian and every reference is
+ * an offset from the start of the file, so the mapped file is used in place.
+ *
+ *   struct cache_header
+ *   path of the script, NUL-terminated, padded to 4 bytes
+ *   records, one per line of the script:
+ *     REC_LINE: uint32 kind, uint32 size, line text (with '\n'), NUL, padding
+ *     REC_PROG: uint32 kind, uint32 size, then struct prog_header, the nodes,
+ *               the word offsets and the text of the program; padding
+ *
+ * REC_LINE is used for bench/limit lines and lines that do not parse, which
+ * run_line handles itself. REC_PROG holds the output of parse_program, whose
+ * nodes and words refer to each other by index and can be run in place.
+ */
+
+#define CACHE_MAGIC "MYSHAST"
+#define CACHE_VERSION 2
+#define CACHE_PATHLEN 4096
+
+#define REC_LINE 1
+#define REC_PROG 2
+
+#define ALIGN4(n) (((n) + 3) & ~(size_t)3)
+
+struct cache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t nrecords;
+  uint64_t src_size;   // size of the script when it was parsed
+  int64_t mtime_sec;   // mtime of the script when it was parsed
+  int64_t mtime_nsec;
+  uint32_t pathlen;    // length of the path, with NUL and padding
+  uint32_t records;    // offset of the first record
+};
+
+/* Sizes of a cached program; the arrays follow, in this order */
+struct prog_header {
+  int32_t nnodes;
+  int32_t nwords;
+  int32_t textlen;
+  int32_t root;
+};
+
+/* Growable buffer the cache image is built in */
+struct image {
+  char *data;
+  size_t len;
+  size_t cap;
+};
+
+/* Function name: image_reserve
+ * Description: make room for n more bytes, zero-filled.
+ * Return: offset of the reserved bytes, or -1 if out of memory.
+ */
+static long image_reserve(struct image *img, size_t n)
+{
+  if (img->len + n > img->cap) {
+    size_t cap = img->cap ? img->cap : 4096;
+    while (cap < img->len + n)
+      cap *= 2;
+    char *data = realloc(img->data, cap);
+    if (data == NULL)
+      return -1;
+    img->data = data;
+    img->cap = cap;
+  }
+  long off = (long)img->len;
+  memset(img->data + off, 0, n);
+  img->len += n;
+  return off;
+}
+
+/* Function name: image_put
+ * Description: append n bytes, then pad the image to 4 bytes if pad is set.
+ * Return: 0 on success, -1 if out of memory.
+ */
+static int image_put(struct image *img, const void *src, size_t n, int pad)
+{
+  long off = image_reserve(img, pad ? ALIGN4(n) : n);
+  if (off < 0)
+    return -1;
+  memcpy(img->data + off, src, n);
+  return 0;
+}
+
+/* Function name: image_put32
+ * Description: append a uint32.
+ */
+static int image_put32(struct image *img, uint32_t val)
+{
+  return image_put(img, &val, sizeof(val), 0);
+}
+
+/* Function name: add_record
+ * Description: parse one line of the script and append its record.
+ * Parameters:
+ *   img: image being built.
+ *   line: line of the script, terminated with '\n'.
+ * Return: 0 on success, -1 if out of memory.
+ */
+static int add_record(struct image *img, const char *line)
+{
+  size_t len = strlen(line);
+  long start = img->len;
+
+  if (image_put32(img, REC_LINE) || image_put32(img, 0))
+    return -1;
+
+  struct program prog;
+  if (is_line_builtin(line) || parse_program(line, &prog)) {
+    /* Keep the text; run_line deals with it */
+    if (image_put(img, line, len + 1, 1))
+      return -1;
+  } else {
+    struct prog_header ph = { prog.nnodes, prog.nwords, prog.textlen, prog.root };
+    int err = image_put(img, &ph, sizeof(ph), 0)
+           || image_put(img, prog.nodes, prog.nnodes * sizeof(struct node), 0)
+           || image_put(img, prog.words, prog.nwords * sizeof(int), 0)
+           || image_put(img, prog.text, prog.textlen, 1);
+    ((uint32_t *)(img->data + start))[0] = REC_PROG;
+    free_program(&prog);
+    if (err)
+      return -1;
+  }
+
+  ((uint32_t *)(img->data + start))[1] = img->len - start; // record size
+  ((struct cache_header *)img->data)->nrecords++;
+  return 0;
+}
+
+/* Function name: build_image
+ * Description: parse a whole script into a cache image.
+ * Parameters:
+ *   img: empty image to fill.
+ *   path: resolved path of the script.
+ *   fd: open descriptor of the script.
+ *   st: stat of the script.
+ * Return: 0 on success, -1 on error (errno is set).
+ */
+static int build_image(struct image *img, const char *path, int fd, struct stat *st)
+{
+  struct cache_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  hdr.version = CACHE_VERSION;
+  hdr.src_size = st->st_size;
+  hdr.mtime_sec = st->st_mtim.tv_sec;
+  hdr.mtime_nsec = st->st_mtim.tv_nsec;
+  hdr.pathlen = ALIGN4(strlen(path) + 1);
+  hdr.records = sizeof(hdr) + hdr.pathlen;
+  if (image_put(img, &hdr, sizeof(hdr), 0) || image_put(img, path, strlen(path) + 1, 1))
+    return -1;
+
+  /* Read the whole script */
+  char *text = malloc(st->st_size + 2);
+  if (text == NULL)
+    return -1;
+  size_t got = 0;
+  while (got < (size_t)st->st_size) {
+    ssize_t n = read(fd, text + got, st->st_size - got);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    got += n;
+  }
+
+  /* One record per line; the last line may lack its '\n' */
+  char *line = text;
+  while (line < text + got) {
+    char *nl = memchr(line, '\n', text + got - line);
+    char saved = 0;
+    if (nl == NULL) {
+      nl = text + got;
+      *nl = '\n';
+    }
+    saved = nl[1];
+    nl[1] = '\0';
+    if (add_record(img, line)) {
+      free(text);
+      return -1;
+    }
+    nl[1] = saved;
+    line = nl + 1;
+  }
+  free(text);
+  return 0;
+}
+
+/* Function name: walk_image
+ * Description: check the records of a cache image, or run them.
+ * Parameters:
+ *   base: start of the image.
+ *   len: length of the image.
+ *   run: 0 to only check that every record lies inside the image,
+ *        1 to run the records (the image must have been checked).
+ * Return: 0 if the image is well formed, -1 otherwise.
+ */
+static int walk_image(const char *base, size_t len, int run)
+{
+  const struct cache_header *hdr = (const struct cache_header *)base;
+  size_t off = hdr->records;
+  uint32_t rec;
+
+  for (rec = 0; rec < hdr->nrecords; rec++) {
+    if (off + 8 > len)
+      return -1;
+    const uint32_t *head = (const uint32_t *)(base + off);
+    uint32_t kind = head[0], size = head[1];
+    if (size < 8 || size % 4 || size > len - off)
+      return -1;
+    const char *p = base + off + 8;
+    const char *end = base + off + size;
+
+    if (kind == REC_LINE) {
+      if (memchr(p, '\0', end - p) == NULL)
+        return -1;
+      if (run) {
+        char *line = strdup(p); // run_line modifies its input
+        int stop = line == NULL || run_line(line);
+        free(line);
+        if (stop)
+          return 0;
+      }
+    } else if (kind == REC_PROG) {
+      const struct prog_header *ph = (const struct prog_header *)p;
+      struct program prog;
+      if (end - p < (long)sizeof(*ph) || ph->nnodes < 0 || ph->nwords < 0 || ph->textlen < 0
+          || ph->nnodes > size || ph->nwords > size || ph->textlen > size
+          || sizeof(*ph) + ph->nnodes * sizeof(struct node) + ph->nwords * sizeof(int)
+             + ph->textlen > (size_t)(end - p))
+        return -1;
+      prog.nnodes = ph->nnodes;
+      prog.nwords = ph->nwords;
+      prog.textlen = ph->textlen;
+      prog.root = ph->root;
+      prog.nodes = (struct node *)(p + sizeof(*ph)); // used in place: the executor only reads it
+      prog.words = (int *)(prog.nodes + prog.nnodes);
+      prog.text = (char *)(prog.words + prog.nwords);
+      if (!run && check_program(&prog))
+        return -1;
+      if (run) {
+        exec_program(&prog);
+        if (shell_exit)
+          return 0;
+      }
+    } else
+      return -1;
+    off += size;
+  }
+  return 0;
+}
+
+/* Function name: cache_file_path
+ * Description: name of the cache file of a script: the FNV-1a hash of its
+ *   resolved path, in $XDG_CACHE_HOME/mysh or ~/.cache/mysh. The directories
+ *   are created as needed.
+ * Parameters:
+ *   buf: output buffer, CACHE_PATHLEN bytes.
+ *   path: resolved path of the script.
+ * Return: 0 on success, -1 if there is no usable cache directory.
+ */
+static int cache_file_path(char *buf, const char *path)
+{
+  const char *base = getenv("XDG_CACHE_HOME");
+  int n;
+
+  if (base && base[0] == '/')
+    n = snprintf(buf, CACHE_PATHLEN, "%s", base);
+  else if ((base = getenv("HOME")) != NULL)
+    n = snprintf(buf, CACHE_PATHLEN, "%s/.cache", base);
+  else
+    return -1;
+  if (n < CACHE_PATHLEN && mkdir(buf, 0700) < 0 && errno != EEXIST)
+    return -1;
+
+  if (n < CACHE_PATHLEN)
+    n += snprintf(buf + n, CACHE_PATHLEN - n, "/mysh");
+  if (n >= CACHE_PATHLEN || (mkdir(buf, 0700) < 0 && errno != EEXIST))
+    return -1;
+
+  uint64_t hash = 14695981039346656037ULL;
+  for ( ; *path; path++) {
+    hash ^= (unsigned char)*path;
+    hash *= 1099511628211ULL;
+  }
+  n += snprintf(buf + n, CACHE_PATHLEN - n, "/%016llx.ast", (unsigned long long)hash);
+  return n < CACHE_PATHLEN ? 0 : -1;
+}
+
+/* Function name: map_cache
+ * Description: map a cache file if it is current for the script.
+ * Parameters:
+ *   cachefile: path of the cache file.
+ *   path: resolved path of the script.
+ *   st: stat of the script.
+ *   len: receives the length of the mapping.
+ * Return: the mapping, or NULL if there is no usable cache.
+ */
+static char *map_cache(const char *cachefile, const char *path, struct stat *st, size_t *len)
+{
+  struct stat cst;
+  int fd = open(cachefile, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &cst) < 0 || cst.st_size < (off_t)sizeof(struct cache_header)) {
+    close(fd);
+    return NULL;
+  }
+
+  char *base = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+  *len = cst.st_size;
+
+  const struct cache_header *hdr = (const struct cache_header *)base;
+  if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC))
+      || hdr->version != CACHE_VERSION
+      || hdr->src_size != (uint64_t)st->st_size
+      || hdr->mtime_sec != st->st_mtim.tv_sec
+      || hdr->mtime_nsec != st->st_mtim.tv_nsec
+      || hdr->records != sizeof(*hdr) + hdr->pathlen
+      || hdr->records > *len
+      || strnlen(base + sizeof(*hdr), hdr->pathlen) != strlen(path)
+      || strcmp(base + sizeof(*hdr), path)
+      || walk_image(base, *len, 0)) {
+    munmap(base, *len);
+    return NULL;
+  }
+  return base;
+}
+
+/* Function name: write_cache
+ * Description: store a cache image, replacing the old cache file atomically.
+ * Return: 0 on success, -1 on error.
+ */
+static int write_cache(const char *cachefile, struct image *img)
+{
+  char tmp[CACHE_PATHLEN + 16];
+  snprintf(tmp, sizeof(tmp), "%s.%ld", cachefile, (long)getpid());
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd < 0)
+    return -1;
+  size_t done = 0;
+  while (done < img->len) {
+    ssize_t n = write(fd, img->data + done, img->len - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      break;
+    done += n;
+  }
+  if (close(fd) < 0 || done < img->len || rename(tmp, cachefile) < 0) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/* Function name: cache_run_script
+ * Description: run a script, from its cache file when that is current.
+ * Parameters:
+ *   path: path of the script.
+ * Return: 0 on success, -1 if the script cannot be read.
+ */
+int cache_run_script(const char *path)
+{
+  char *resolved = realpath(path, NULL);
+  if (resolved == NULL) {
+    perror("run_shell: cache_run_script");
+    return -1;
+  }
+  int fd = open(resolved, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror("run_shell: cache_run_script");
+    if (fd >= 0)
+      close(fd);
+    free(resolved);
+    return -1;
+  }
+
+  char cachefile[CACHE_PATHLEN];
+  int use_cache = getenv("MYSH_NO_CACHE") == NULL && cache_file_path(cachefile, resolved) == 0;
+  size_t len;
+  char *base = use_cache ? map_cache(cachefile, resolved, &st, &len) : NULL;
+
+  if (base != NULL) { /* Cache hit: walk the mapped file */
+    close(fd);
+    free(resolved);
+    walk_image(base, len, 1);
+    munmap(base, len);
+    return 0;
+  }
+
+  /* Cache miss: parse the script, store the image, and run it from memory */
+  struct image img = { NULL, 0, 0 };
+  if (build_image(&img, resolved, fd, &st)) {
+    perror("run_shell: cache_run_script");
+    close(fd);
+    free(resolved);
+    free(img.data);
+    return -1;
+  }
+  close(fd);
+  free(resolved);
+  if (use_cache)
+    write_cache(cachefile, &img);
+  walk_image(img.data, img.len, 1);
+  free(img.data);
+  return 0;
+}
@@ -0,0 +1,30 @@
+/*  File name: cache.h
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#ifndef cache_h
+#define cache_h
+
+/* Function name: cache_run_script
+ * Description: Run every line of a script file.
+ *   The parsed form of the script (the command chunks of every line) is kept
+ *   in a cache file under $XDG_CACHE_HOME/mysh (or ~/.cache/mysh). The cache
+ *   file only stores offsets, so it is memory-mapped and walked directly on
+ *   the next run, as long as the script's path, size and mtime still match.
+ *   Otherwise the script is parsed again and the cache file is rewritten.
+ *   Setting MYSH_NO_CACHE in the environment bypasses the cache.
+ *
+ * Parameters:
+ *   path, path of the script to run.
+ * Output:
+ *   Returns 0 when the script ran (or stopped at "exit"), -1 if it could not
+ *   be read.
+ * Error handling:
+ *   Failing to read or write the cache is not an error; the script is then
+ *   run from the freshly parsed copy in memory.
+ */
+int cache_run_script(const char *path);
+
+#endif /* cache_h */
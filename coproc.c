@@ -0,0 +1,232 @@
+/*  File name: coproc.c
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coproc.h"
+#include "util.h"
+
+#define COPROC_MAXARGS 100
+#define COPROC_MAXPOOL 64
+#define COPROC_NAMELEN 32
+#define COPROC_GRACE_MS 500 /* Time helpers get to exit on end of file when stopped */
+#define COPROC_USAGE "usage: coproc [-n N] NAME cmd args... | coproc -k NAME | coproc\n"
+
+struct coproc {
+  char name[COPROC_NAMELEN];
+  char cmd[64];
+  int n;          // helpers in the pool
+  int next;       // helper the next ">&NAME" goes to
+  int last;       // helper written to last, which "<&NAME" reads from
+  pid_t pid[COPROC_MAXPOOL]; // 0 once the helper has been reaped
+  int to[COPROC_MAXPOOL];   // write end of each helper's stdin
+  int from[COPROC_MAXPOOL]; // read end of each helper's stdout
+  struct coproc *link;
+};
+
+static struct coproc *coprocs = NULL;
+
+/* Function name: find_coproc
+ * Description: look up a coprocess by name.
+ */
+static struct coproc *find_coproc(const char *name)
+{
+  struct coproc *cp;
+  for (cp = coprocs; cp != NULL && strcmp(cp->name, name); cp = cp->link);
+  return cp;
+}
+
+/* Function name: stop_coproc
+ * Description: close the pipes of a coprocess and reap its helpers. Helpers
+ *   see end of file on stdin and get COPROC_GRACE_MS to exit by themselves
+ *   before they are sent SIGTERM. Whatever they still write is discarded.
+ */
+static void stop_coproc(struct coproc *cp)
+{
+  struct timespec tick = { 0, 10 * 1000000 };
+  int i, ms, left;
+
+  for (i = 0; i < cp->n; i++) {
+    close(cp->to[i]);
+    close(cp->from[i]);
+  }
+  for (ms = 0; ; ms += 10) {
+    for (i = 0, left = 0; i < cp->n; i++) {
+      if (cp->pid[i] > 0 && waitpid(cp->pid[i], NULL, WNOHANG) == cp->pid[i])
+        cp->pid[i] = 0;
+      left += cp->pid[i] > 0;
+    }
+    if (left == 0 || ms >= COPROC_GRACE_MS)
+      break;
+    nanosleep(&tick, NULL);
+  }
+  for (i = 0; i < cp->n; i++) {
+    if (cp->pid[i] > 0) {
+      kill(cp->pid[i], SIGTERM);
+      waitpid(cp->pid[i], NULL, 0);
+    }
+  }
+}
+
+/* Function name: start_coproc
+ * Description: start the helpers of a new coprocess.
+ * Parameters:
+ *   cp: coprocess with its name and pool size set.
+ *   argv: command of the helpers, NULL-terminated.
+ * Return: 0 on success, -1 on error (helpers already started are stopped).
+ */
+static int start_coproc(struct coproc *cp, char *argv[])
+{
+  int n = cp->n, i;
+
+  for (cp->n = 0; cp->n < n; cp->n++) {
+    int to[2], from[2];
+    if (pipe(to) < 0)
+      break;
+    if (pipe(from) < 0) {
+      close(to[0]);
+      close(to[1]);
+      break;
+    }
+    /* The shell's ends must not leak into later children */
+    fcntl(to[1], F_SETFD, FD_CLOEXEC);
+    fcntl(from[0], F_SETFD, FD_CLOEXEC);
+    cp->pid[cp->n] = run_child(argv[0], argv, to[0], from[1], 2);
+    close(to[0]);
+    close(from[1]);
+    cp->to[cp->n] = to[1];
+    cp->from[cp->n] = from[0];
+    if (cp->pid[cp->n] < 0) {
+      close(to[1]);
+      close(from[0]);
+      break;
+    }
+  }
+  if (cp->n < n) {
+    perror("run_shell: coproc");
+    stop_coproc(cp);
+    return -1;
+  }
+
+  for (i = 0; argv[i] != NULL; i++) {
+    size_t used = strlen(cp->cmd);
+    snprintf(cp->cmd + used, sizeof(cp->cmd) - used, "%s%s", i ? " " : "", argv[i]);
+  }
+  return 0;
+}
+
+/* Function name: coproc_fd
+ * Description: descriptor for a coprocess redirection, see coproc.h.
+ */
+int coproc_fd(const char *name, int writing)
+{
+  struct coproc *cp = find_coproc(name);
+  if (cp == NULL)
+    return -1;
+  if (!writing)
+    return cp->from[cp->last];
+  cp->last = cp->next;
+  cp->next = (cp->next + 1) % cp->n;
+  return cp->to[cp->last];
+}
+
+/* Function name: coproc_reaped
+ * Description: forget a helper reaped by the shell, see coproc.h.
+ */
+int coproc_reaped(pid_t pid)
+{
+  struct coproc *cp;
+  int i;
+  for (cp = coprocs; cp != NULL; cp = cp->link) {
+    for (i = 0; i < cp->n; i++) {
+      if (cp->pid[i] == pid) {
+        cp->pid[i] = 0;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Function name: shell_coproc
+ * Description: the coproc builtin, see coproc.h.
+ */
+int shell_coproc(char *arg)
+{
+  char *argv[COPROC_MAXARGS + 1];
+  int argc = tokenize(arg, argv, COPROC_MAXARGS);
+  struct coproc *cp, **link;
+  int i, first = 1, n = 1;
+
+  if (argc == 1) { /* List the coprocesses */
+    for (cp = coprocs; cp != NULL; cp = cp->link) {
+      printf("%s:", cp->name);
+      for (i = 0; i < cp->n; i++) {
+        if (cp->pid[i] > 0)
+          printf(" %d", cp->pid[i]);
+        else
+          printf(" (exited)");
+      }
+      printf("  %s\n", cp->cmd);
+    }
+    return 0;
+  }
+
+  if (argc == 3 && !strcmp(argv[1], "-k")) {
+    for (link = &coprocs; *link != NULL && strcmp((*link)->name, argv[2]); link = &(*link)->link);
+    if ((cp = *link) == NULL) {
+      fprintf(stderr, "coproc: no coprocess %s\n", argv[2]);
+      return -1;
+    }
+    *link = cp->link;
+    stop_coproc(cp);
+    free(cp);
+    return 0;
+  }
+
+  if (argc > 2 && !strcmp(argv[1], "-n")) {
+    char *end;
+    n = (int)strtol(argv[2], &end, 10);
+    if (*end || n < 1 || n > COPROC_MAXPOOL) {
+      fprintf(stderr, "coproc: pool size must be between 1 and %d\n", COPROC_MAXPOOL);
+      return -1;
+    }
+    first = 3;
+  }
+  if (argc < first + 2 || strlen(argv[first]) >= COPROC_NAMELEN) {
+    fputs(COPROC_USAGE, stderr);
+    return -1;
+  }
+  if (find_coproc(argv[first]) != NULL) {
+    fprintf(stderr, "coproc: %s is already running\n", argv[first]);
+    return -1;
+  }
+
+  if ((cp = calloc(1, sizeof(struct coproc))) == NULL) {
+    perror("run_shell: coproc");
+    return -1;
+  }
+  strcpy(cp->name, argv[first]);
+  cp->n = n;
+  if (start_coproc(cp, argv + first + 1) < 0) {
+    free(cp);
+    return -1;
+  }
+  for (link = &coprocs; *link != NULL; link = &(*link)->link);
+  *link = cp;
+  return 0;
+}
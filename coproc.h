@@ -0,0 +1,56 @@
+/*  File name: coproc.h
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#ifndef coproc_h
+#define coproc_h
+
+#include <sys/types.h>
+
+/* Function name: shell_coproc
+ * Description: The coproc builtin.
+ *   coproc [-n N] NAME cmd args...  start N copies (default 1) of cmd
+ *   coproc -k NAME                  close NAME's pipes and stop its helpers
+ *   coproc                          list the coprocesses
+ *   Each helper is started once through run_child, with its stdin and stdout
+ *   on pipes kept open by the shell. Commands then talk to it with the
+ *   redirections ">&NAME" (write to its stdin) and "<&NAME" (read from its
+ *   stdout). With a pool, every ">&NAME" goes to the next helper in turn and
+ *   "<&NAME" reads from the helper written to last.
+ *   Helpers should flush every reply (e.g. sed -u, or stdbuf -oL), and
+ *   readers should stop after one reply (e.g. head -n 1).
+ *   coproc -k closes the pipes first and gives the helpers half a second to
+ *   exit on end of file before sending SIGTERM; output they write after
+ *   their stdin is closed is discarded.
+ *
+ * Parameters:
+ *   arg, the whole input line, terminated with '\n'.
+ * Output:
+ *   Returns 0 on success, -1 on error.
+ */
+int shell_coproc(char *arg);
+
+/* Function name: coproc_fd
+ * Description: Descriptor for a ">&NAME" or "<&NAME" redirection.
+ * Parameters:
+ *   name, name of the coprocess.
+ *   writing, 1 for ">&NAME" (the helper's stdin), 0 for "<&NAME" (its stdout).
+ * Output:
+ *   Returns the descriptor, or -1 if there is no coprocess of that name.
+ *   The descriptor stays owned by the coprocess and must not be closed.
+ */
+int coproc_fd(const char *name, int writing);
+
+/* Function name: coproc_reaped
+ * Description: Tell whether a reaped child was one of the helpers, so that
+ *   coproc -k does not signal or wait for it again.
+ * Parameters:
+ *   pid, PID returned by waitpid.
+ * Output:
+ *   Returns 1 for a helper, 0 otherwise.
+ */
+int coproc_reaped(pid_t pid);
+
+#endif /* coproc_h */
@@ -0,0 +1,896 @@
+/*  File name: exec.c
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "coproc.h"
+#include "exec.h"
+#include "joblog.h"
+#include "limit.h"
+#include "myshell.h"
+#include "util.h"
+
+#define EXEC_MAXARGS 256   /* Words in one pipeline */
+#define EXEC_MAXSTAGES 32  /* Commands in one pipeline */
+#define EXEC_BUFSIZE 8192  /* Expanded words of one pipeline */
+#define EXEC_MAXVARS 64
+#define EXEC_NAMELEN 32
+
+/* Token kinds */
+#define T_WORD 1
+#define T_SEMI 2
+#define T_AND 3
+#define T_OR 4
+#define T_PIPE 5
+#define T_END 6
+
+struct token {
+  int kind;
+  int word; // index in the program's words, for T_WORD
+};
+
+struct parser {
+  struct program *prog;
+  struct token *toks;
+  int pos;
+};
+
+/* Shell variables, set by for and read */
+struct var {
+  char name[EXEC_NAMELEN];
+  char *value;
+  size_t cap;
+};
+
+/* A builtin run inside the shell: argc/argv without redirections, and the descriptors to use */
+struct builtin {
+  const char *name;
+  int (*fn)(int argc, char *argv[], int in, int out);
+};
+
+int last_status = 0;
+int shell_exit = 0;
+
+static struct var vars[EXEC_MAXVARS];
+static int nvars = 0;
+
+/* ---------------------------------------------------------------- parsing */
+
+/* Function name: lex
+ * Description: split a line into tokens, copying the words into the program.
+ *   ';', '&&', '||' and '|' are operators wherever they appear; a '#' at the
+ *   start of a word starts a comment.
+ * Return: number of tokens, the last one being T_END.
+ */
+static int lex(const char *line, struct program *prog, struct token *toks)
+{
+  const char *p = line;
+  int n = 0;
+
+  for (;; n++) {
+    while (*p != '\n' && isspace((unsigned char)*p))
+      p++;
+    if (*p == '\0' || *p == '\n' || *p == '#') {
+      toks[n].kind = T_END;
+      return n + 1;
+    }
+    if (*p == ';') {
+      toks[n].kind = T_SEMI;
+      p++;
+    } else if (p[0] == '&' && p[1] == '&') {
+      toks[n].kind = T_AND;
+      p += 2;
+    } else if (p[0] == '|' && p[1] == '|') {
+      toks[n].kind = T_OR;
+      p += 2;
+    } else if (*p == '|') {
+      toks[n].kind = T_PIPE;
+      p++;
+    } else {
+      const char *start = p;
+      while (*p && !isspace((unsigned char)*p) && *p != ';' && *p != '|' && !(p[0] == '&' && p[1] == '&'))
+        p++;
+      toks[n].kind = T_WORD;
+      toks[n].word = prog->nwords;
+      prog->words[prog->nwords++] = prog->textlen;
+      memcpy(prog->text + prog->textlen, start, p - start);
+      prog->textlen += p - start;
+      prog->text[prog->textlen++] = '\0';
+    }
+  }
+}
+
+/* Function name: new_node
+ * Description: append a node to the program.
+ * Return: index of the node.
+ */
+static int new_node(struct parser *ps, int type, int a, int b, int c, int d)
+{
+  struct node *node = &ps->prog->nodes[ps->prog->nnodes];
+  node->type = type;
+  node->a = a;
+  node->b = b;
+  node->c = c;
+  node->d = d;
+  return ps->prog->nnodes++;
+}
+
+/* Function name: is_keyword
+ * Description: check whether the next token is the word kw.
+ */
+static int is_keyword(struct parser *ps, const char *kw)
+{
+  struct token *tok = &ps->toks[ps->pos];
+  return tok->kind == T_WORD && !strcmp(ps->prog->text + ps->prog->words[tok->word], kw);
+}
+
+/* Function name: expect
+ * Description: skip the keyword kw.
+ * Return: 0 on success, -1 if the next token is something else.
+ */
+static int expect(struct parser *ps, const char *kw)
+{
+  if (!is_keyword(ps, kw))
+    return -1;
+  ps->pos++;
+  return 0;
+}
+
+/* Function name: at_terminator
+ * Description: check whether the next token ends a list.
+ */
+static int at_terminator(struct parser *ps)
+{
+  return ps->toks[ps->pos].kind == T_END || is_keyword(ps, "then") || is_keyword(ps, "elif")
+      || is_keyword(ps, "else") || is_keyword(ps, "fi") || is_keyword(ps, "do")
+      || is_keyword(ps, "done");
+}
+
+static int parse_list(struct parser *ps);
+
+/* Function name: parse_if
+ * Description: parse "if"/"elif" list "then" list [...] "fi".
+ * Return: node index, or -1 on syntax error.
+ */
+static int parse_if(struct parser *ps)
+{
+  int cond, body, other = -1;
+
+  ps->pos++; // "if" or "elif"
+  if ((cond = parse_list(ps)) < 0 || expect(ps, "then") < 0 || (body = parse_list(ps)) < 0)
+    return -1;
+  if (is_keyword(ps, "elif")) { /* The elif chain consumes the "fi" */
+    if ((other = parse_if(ps)) < 0)
+      return -1;
+    return new_node(ps, N_IF, cond, body, other, -1);
+  }
+  if (is_keyword(ps, "else")) {
+    ps->pos++;
+    if ((other = parse_list(ps)) < 0)
+      return -1;
+  }
+  if (expect(ps, "fi") < 0)
+    return -1;
+  return new_node(ps, N_IF, cond, body, other, -1);
+}
+
+/* Function name: parse_loop
+ * Description: parse "while"/"until" list "do" list "done".
+ * Return: node index, or -1 on syntax error.
+ */
+static int parse_loop(struct parser *ps, int type)
+{
+  int cond, body;
+
+  ps->pos++; // "while" or "until"
+  if ((cond = parse_list(ps)) < 0 || expect(ps, "do") < 0 || (body = parse_list(ps)) < 0
+      || expect(ps, "done") < 0)
+    return -1;
+  return new_node(ps, type, cond, body, -1, -1);
+}
+
+/* Function name: parse_for
+ * Description: parse "for" NAME "in" word* ";" "do" list "done".
+ * Return: node index, or -1 on syntax error.
+ */
+static int parse_for(struct parser *ps)
+{
+  struct token *tok;
+  const char *name;
+  int var, first = 0, count = 0, body;
+
+  ps->pos++; // "for"
+  tok = &ps->toks[ps->pos];
+  if (tok->kind != T_WORD)
+    return -1;
+  var = tok->word;
+  name = ps->prog->text + ps->prog->words[var];
+  if (!(isalpha((unsigned char)*name) || *name == '_') || strlen(name) >= EXEC_NAMELEN)
+    return -1;
+  for ( ; *name; name++)
+    if (!isalnum((unsigned char)*name) && *name != '_')
+      return -1;
+  ps->pos++;
+
+  if (expect(ps, "in") < 0)
+    return -1;
+  for (tok = &ps->toks[ps->pos]; tok->kind == T_WORD; tok = &ps->toks[++ps->pos]) {
+    if (count++ == 0)
+      first = tok->word;
+  }
+  if (tok->kind != T_SEMI)
+    return -1;
+  ps->pos++;
+
+  if (expect(ps, "do") < 0 || (body = parse_list(ps)) < 0 || expect(ps, "done") < 0)
+    return -1;
+  return new_node(ps, N_FOR, var, first, count, body);
+}
+
+/* Function name: parse_pipeline
+ * Description: parse a compound command, or simple commands joined by '|'.
+ *   The N_CMD nodes of a pipeline are allocated one after the other.
+ * Return: node index, or -1 on syntax error.
+ */
+static int parse_pipeline(struct parser *ps)
+{
+  int first = -1, count = 0;
+
+  if (is_keyword(ps, "if"))
+    return parse_if(ps);
+  if (is_keyword(ps, "while"))
+    return parse_loop(ps, N_WHILE);
+  if (is_keyword(ps, "until"))
+    return parse_loop(ps, N_UNTIL);
+  if (is_keyword(ps, "for"))
+    return parse_for(ps);
+  if (at_terminator(ps))
+    return -1;
+
+  do {
+    if (count > 0)
+      ps->pos++; // '|'
+    if (ps->toks[ps->pos].kind != T_WORD)
+      return -1;
+    int word = ps->toks[ps->pos].word, nwords = 0;
+    for ( ; ps->toks[ps->pos].kind == T_WORD; ps->pos++)
+      nwords++;
+    int cmd = new_node(ps, N_CMD, word, nwords, -1, -1);
+    if (first < 0)
+      first = cmd;
+    count++;
+  } while (ps->toks[ps->pos].kind == T_PIPE);
+
+  return new_node(ps, N_PIPE, first, count, -1, -1);
+}
+
+/* Function name: parse_and_or
+ * Description: parse pipelines joined by '&&' and '||', left to right.
+ * Return: node index, or -1 on syntax error.
+ */
+static int parse_and_or(struct parser *ps)
+{
+  int n = parse_pipeline(ps);
+
+  while (n >= 0 && (ps->toks[ps->pos].kind == T_AND || ps->toks[ps->pos].kind == T_OR)) {
+    int type = ps->toks[ps->pos].kind == T_AND ? N_AND : N_OR;
+    ps->pos++;
+    int m = parse_pipeline(ps);
+    n = m < 0 ? -1 : new_node(ps, type, n, m, -1, -1);
+  }
+  return n;
+}
+
+/* Function name: parse_list
+ * Description: parse and-or lists separated by ';', up to a keyword that
+ *   ends the list or the end of the line.
+ * Return: node index, or -1 on syntax error.
+ */
+static int parse_list(struct parser *ps)
+{
+  int n = parse_and_or(ps);
+
+  while (n >= 0 && ps->toks[ps->pos].kind == T_SEMI) {
+    ps->pos++;
+    if (at_terminator(ps))
+      break;
+    int m = parse_and_or(ps);
+    n = m < 0 ? -1 : new_node(ps, N_SEQ, n, m, -1, -1);
+  }
+  return n;
+}
+
+/* Function name: parse_program
+ * Description: parse a line, see exec.h.
+ */
+int parse_program(const char *line, struct program *prog)
+{
+  size_t len = strcspn(line, "\n");
+  struct parser ps;
+
+  /* Every token takes at least one character, so these bounds always hold */
+  memset(prog, 0, sizeof(*prog));
+  ps.toks = malloc((len + 2) * sizeof(struct token));
+  prog->words = malloc((len + 1) * sizeof(int));
+  prog->text = malloc(2 * len + 2);
+  prog->nodes = malloc((2 * len + 4) * sizeof(struct node));
+  if (ps.toks == NULL || prog->words == NULL || prog->text == NULL || prog->nodes == NULL) {
+    perror("run_shell: parse_program");
+    free(ps.toks);
+    free_program(prog);
+    return -1;
+  }
+  ps.prog = prog;
+  ps.pos = 0;
+
+  lex(line, prog, ps.toks);
+  prog->root = ps.toks[0].kind == T_END ? -1 : parse_list(&ps);
+  if ((prog->root < 0 && ps.toks[0].kind != T_END) || ps.toks[ps.pos].kind != T_END) {
+    free(ps.toks);
+    free_program(prog);
+    return -1;
+  }
+  free(ps.toks);
+  return 0;
+}
+
+/* Function name: free_program
+ * Description: release a parsed program.
+ */
+void free_program(struct program *prog)
+{
+  free(prog->nodes);
+  free(prog->words);
+  free(prog->text);
+  memset(prog, 0, sizeof(*prog));
+}
+
+/* Function name: check_program
+ * Description: bounds-check a program, see exec.h.
+ */
+int check_program(const struct program *prog)
+{
+  int i;
+
+  if (prog->nnodes < 0 || prog->nwords < 0 || prog->textlen < 0
+      || prog->root < -1 || prog->root >= prog->nnodes
+      || (prog->textlen > 0 && prog->text[prog->textlen - 1] != '\0')
+      || (prog->nwords > 0 && prog->textlen == 0))
+    return -1;
+  for (i = 0; i < prog->nwords; i++)
+    if (prog->words[i] < 0 || prog->words[i] >= prog->textlen)
+      return -1;
+
+  /* Children come before their parent, which also rules out cycles */
+  for (i = 0; i < prog->nnodes; i++) {
+    const struct node *n = &prog->nodes[i];
+    int j;
+    switch (n->type) {
+    case N_PIPE:
+      if (n->a < 0 || n->b < 1 || n->a + n->b > i)
+        return -1;
+      for (j = n->a; j < n->a + n->b; j++)
+        if (prog->nodes[j].type != N_CMD)
+          return -1;
+      break;
+    case N_CMD:
+      if (n->a < 0 || n->b < 1 || n->a + n->b > prog->nwords)
+        return -1;
+      break;
+    case N_IF:
+      if (n->c < -1 || n->c >= i)
+        return -1;
+      /* fall through */
+    case N_SEQ: case N_AND: case N_OR: case N_WHILE: case N_UNTIL:
+      if (n->a < 0 || n->a >= i || n->b < 0 || n->b >= i)
+        return -1;
+      break;
+    case N_FOR:
+      if (n->a < 0 || n->a >= prog->nwords || n->b < 0 || n->c < 0
+          || n->b + n->c > prog->nwords || n->d < 0 || n->d >= i)
+        return -1;
+      break;
+    default:
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* -------------------------------------------------------------- variables */
+
+/* Function name: find_var
+ * Description: look up a shell variable by name (len bytes of name).
+ * Return: the variable, or NULL.
+ */
+static struct var *find_var(const char *name, size_t len)
+{
+  int i;
+  for (i = 0; i < nvars; i++)
+    if (!strncmp(vars[i].name, name, len) && vars[i].name[len] == '\0')
+      return &vars[i];
+  return NULL;
+}
+
+/* Function name: make_var
+ * Description: look up a shell variable, creating it if need be.
+ * Return: the variable, or NULL if the name is too long or the table is full.
+ */
+static struct var *make_var(const char *name)
+{
+  size_t len = strlen(name);
+  struct var *v = find_var(name, len);
+  if (v != NULL)
+    return v;
+  if (len >= EXEC_NAMELEN || nvars == EXEC_MAXVARS) {
+    fprintf(stderr, "run_shell: cannot set %s\n", name);
+    return NULL;
+  }
+  v = &vars[nvars++];
+  strcpy(v->name, name);
+  v->value = NULL;
+  v->cap = 0;
+  return v;
+}
+
+/* Function name: assign_var
+ * Description: set the value of a shell variable, reusing its storage.
+ * Return: 0 on success, -1 if out of memory.
+ */
+static int assign_var(struct var *v, const char *value)
+{
+  size_t len = strlen(value);
+  if (len + 1 > v->cap) {
+    char *mem = realloc(v->value, len + 1);
+    if (mem == NULL) {
+      perror("run_shell: assign_var");
+      return -1;
+    }
+    v->value = mem;
+    v->cap = len + 1;
+  }
+  memcpy(v->value, value, len + 1);
+  return 0;
+}
+
+/* Function name: get_var
+ * Description: value of a shell variable, or else of an environment variable.
+ * Return: the value, or NULL if neither is set.
+ */
+static const char *get_var(const char *name, size_t len)
+{
+  char key[EXEC_NAMELEN];
+  struct var *v = find_var(name, len);
+  if (v != NULL)
+    return v->value;
+  if (len >= EXEC_NAMELEN)
+    return NULL;
+  memcpy(key, name, len);
+  key[len] = '\0';
+  return getenv(key);
+}
+
+/* Function name: expand
+ * Description: expand $NAME, ${NAME} and $? in a word. Words without '$'
+ *   are returned as they are; others are written at *bufp, which is moved
+ *   past the result.
+ * Parameters:
+ *   word: the word.
+ *   bufp: pointer to the free space of the output buffer.
+ *   end: end of the output buffer.
+ * Return: the expanded word, or NULL if the buffer is full.
+ */
+static char *expand(const char *word, char **bufp, char *end)
+{
+  char *start = *bufp, *o = start;
+  const char *p = word;
+
+  if (strchr(word, '$') == NULL)
+    return (char *)word; // read only from here on
+  while (*p) {
+    const char *val = NULL, *name = NULL;
+    char status[16];
+    size_t len = 0;
+    if (*p != '$') {
+      if (o < end)
+        *o++ = *p;
+      p++;
+      continue;
+    }
+    if (p[1] == '?') {
+      snprintf(status, sizeof(status), "%d", last_status);
+      val = status;
+      p += 2;
+    } else if (p[1] == '{' && strchr(p + 2, '}') != NULL) {
+      name = p + 2;
+      len = strchr(name, '}') - name;
+      p = name + len + 1;
+    } else if (isalpha((unsigned char)p[1]) || p[1] == '_') {
+      name = p + 1;
+      while (isalnum((unsigned char)name[len]) || name[len] == '_')
+        len++;
+      p = name + len;
+    } else { /* A lone '$' */
+      if (o < end)
+        *o++ = *p;
+      p++;
+      continue;
+    }
+    if (name != NULL)
+      val = get_var(name, len);
+    for ( ; val && *val && o < end; val++)
+      *o++ = *val;
+  }
+  if (o >= end)
+    return NULL;
+  *o++ = '\0';
+  *bufp = o;
+  return start;
+}
+
+/* --------------------------------------------------------------- builtins */
+
+/* Function name: line_builtin
+ * Description: call a builtin that parses its own input line, rebuilding the
+ *   line from the expanded words.
+ */
+static int line_builtin(int (*fn)(char *), int argc, char *argv[])
+{
+  char line[EXEC_BUFSIZE];
+  size_t used = 0;
+  int i;
+
+  for (i = 0; i < argc && used < sizeof(line) - 2; i++)
+    used += snprintf(line + used, sizeof(line) - 2 - used, "%s%s", i ? " " : "", argv[i]);
+  if (used > sizeof(line) - 2)
+    used = sizeof(line) - 2;
+  line[used++] = '\n';
+  line[used] = '\0';
+  return fn(line) ? 1 : 0;
+}
+
+static int b_true(int argc, char *argv[], int in, int out) { return 0; }
+static int b_false(int argc, char *argv[], int in, int out) { return 1; }
+static int b_about(int argc, char *argv[], int in, int out) { return shell_about(); }
+static int b_clr(int argc, char *argv[], int in, int out) { return shell_clear(); }
+static int b_environ(int argc, char *argv[], int in, int out) { return shell_env(); }
+static int b_help(int argc, char *argv[], int in, int out) { return shell_help(); }
+static int b_cd(int argc, char *argv[], int in, int out) { return line_builtin(shell_cd, argc, argv); }
+static int b_dir(int argc, char *argv[], int in, int out) { return line_builtin(shell_dir, argc, argv); }
+static int b_bench(int argc, char *argv[], int in, int out) { return line_builtin(shell_bench, argc, argv); }
+static int b_limit(int argc, char *argv[], int in, int out) { return line_builtin(shell_limit, argc, argv); }
+static int b_joblog(int argc, char *argv[], int in, int out) { return line_builtin(shell_joblog, argc, argv); }
+static int b_coproc(int argc, char *argv[], int in, int out) { return line_builtin(shell_coproc, argc, argv); }
+
+/* Function name: b_echo
+ * Description: echo [-n] args..., written with a single write().
+ * Return: 0, or 1 if the output could not be written.
+ */
+static int b_echo(int argc, char *argv[], int in, int out)
+{
+  char buf[EXEC_BUFSIZE];
+  size_t used = 0;
+  int i = 1, newline = 1, err = 0;
+
+  if (argc > 1 && !strcmp(argv[1], "-n")) {
+    newline = 0;
+    i++;
+  }
+  for ( ; i < argc && !err; i++) {
+    size_t len = strlen(argv[i]);
+    if (used + len + 2 > sizeof(buf)) {
+      err = write_all(out, buf, used) < 0;
+      used = 0;
+    }
+    if (len + 2 > sizeof(buf)) {
+      err = err || write_all(out, argv[i], len) < 0;
+    } else {
+      memcpy(buf + used, argv[i], len);
+      used += len;
+    }
+    if (i + 1 < argc)
+      buf[used++] = ' ';
+  }
+  if (newline)
+    buf[used++] = '\n';
+  if (err || write_all(out, buf, used) < 0) { // EPIPE when a coprocess is gone: SIGPIPE is ignored
+    perror("run_shell: write");
+    return 1;
+  }
+  return 0;
+}
+
+/* Function name: b_read
+ * Description: read [NAME]: read one line into NAME (default REPLY). Standard
+ *   input is read through stdio, since the prompt loop's fgets may already
+ *   hold the line in stdin's buffer; any other input is read a byte at a time,
+ *   so nothing after the line is taken from it.
+ * Return: 0, or 1 at end of file.
+ */
+static int b_read(int argc, char *argv[], int in, int out)
+{
+  char buf[EXEC_BUFSIZE];
+  size_t used = 0;
+  ssize_t n = 0;
+  struct var *v = make_var(argc > 1 ? argv[1] : "REPLY");
+
+  if (v == NULL)
+    return 2;
+  while (used < sizeof(buf) - 1) {
+    if (in == STDIN_FILENO) {
+      int c = getchar();
+      n = c != EOF;
+      buf[used] = (char)c;
+    } else
+      n = read(in, buf + used, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0 || buf[used] == '\n')
+      break;
+    used++;
+  }
+  buf[used] = '\0';
+  if (assign_var(v, buf) < 0)
+    return 2;
+  return (n <= 0 && used == 0) ? 1 : 0;
+}
+
+/* Function name: b_exit
+ * Description: exit [status]: stop the shell after the current line.
+ */
+static int b_exit(int argc, char *argv[], int in, int out)
+{
+  shell_exit = 1;
+  return argc > 1 ? atoi(argv[1]) : last_status;
+}
+
+static const struct builtin builtins[] = {
+  { "true", b_true }, { ":", b_true }, { "false", b_false }, { "echo", b_echo },
+  { "read", b_read }, { "exit", b_exit }, { "cd", b_cd }, { "dir", b_dir },
+  { "about", b_about }, { "clr", b_clr }, { "environ", b_environ }, { "help", b_help },
+  { "bench", b_bench }, { "limit", b_limit }, { "joblog", b_joblog }, { "coproc", b_coproc },
+  { NULL, NULL }
+};
+
+/* Function name: find_builtin
+ * Description: look up a builtin by name.
+ */
+static const struct builtin *find_builtin(const char *name)
+{
+  const struct builtin *b;
+  for (b = builtins; b->name != NULL; b++)
+    if (!strcmp(b->name, name))
+      return b;
+  return NULL;
+}
+
+/* Function name: run_builtin
+ * Description: run a builtin in the shell. The redirections <, >, <&NAME and
+ *   >&NAME apply to echo and read; a trailing '&' is ignored, since a builtin
+ *   always runs in the shell.
+ * Return: exit status of the builtin.
+ */
+static int run_builtin(const struct builtin *b, int argc, char *argv[])
+{
+  int in = STDIN_FILENO, out = STDOUT_FILENO;
+  int opened[2] = { -1, -1 };
+  int i, n = 0, status = 1, err = 0;
+
+  if (b->fn == b_echo || b->fn == b_read) {
+    for (i = 0; i < argc && !err; i++) {
+      int writing = argv[i][0] == '>';
+      int fd = -2;
+      if ((!strcmp(argv[i], ">") || !strcmp(argv[i], "<")) && i + 1 < argc) {
+        fd = open(argv[++i], writing ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY, S_IRUSR | S_IWUSR);
+        if (fd < 0)
+          perror("run_shell: run_builtin");
+        else
+          opened[writing] = fd;
+      } else if ((!strncmp(argv[i], ">&", 2) || !strncmp(argv[i], "<&", 2)) && argv[i][2]) {
+        if ((fd = coproc_fd(argv[i] + 2, writing)) < 0)
+          fprintf(stderr, "run_shell: no coprocess %s\n", argv[i] + 2);
+      } else if (i == argc - 1 && !strcmp(argv[i], "&")) {
+        continue;
+      } else {
+        argv[n++] = argv[i];
+        continue;
+      }
+      if (fd < 0)
+        err = 1;
+      else if (writing)
+        out = fd;
+      else
+        in = fd;
+    }
+    argv[n] = NULL;
+    argc = n;
+  }
+
+  if (!err) {
+    fflush(stdout); // keep the output of builtins in order with what echo writes directly
+    status = b->fn(argc, argv, in, out);
+    fflush(stdout);
+  }
+  for (i = 0; i < 2; i++)
+    if (opened[i] >= 0)
+      close(opened[i]);
+  return status;
+}
+
+/* -------------------------------------------------------------- execution */
+
+static int exec_node(const struct program *prog, int n);
+
+/* Function name: exec_pipeline
+ * Description: expand the words of a pipeline into the preallocated argv
+ *   storage and run it: a lone builtin in the shell, anything else through
+ *   run_commands.
+ * Return: exit status.
+ */
+static int exec_pipeline(const struct program *prog, const struct node *pipe)
+{
+  static char *args[EXEC_MAXARGS + EXEC_MAXSTAGES];
+  static struct command stages[EXEC_MAXSTAGES];
+  static char buf[EXEC_BUFSIZE];
+  const struct builtin *b;
+  char *bp = buf;
+  int i, j, used = 0;
+
+  if (pipe->b > EXEC_MAXSTAGES) {
+    fprintf(stderr, "run_shell: too many commands in pipeline\n");
+    return 2;
+  }
+  for (i = 0; i < pipe->b; i++) {
+    const struct node *cmd = &prog->nodes[pipe->a + i];
+    if (used + cmd->b + 1 > EXEC_MAXARGS + EXEC_MAXSTAGES) {
+      fprintf(stderr, "run_shell: too many arguments\n");
+      return 2;
+    }
+    stages[i].argv = args + used;
+    stages[i].argc = cmd->b;
+    for (j = 0; j < cmd->b; j++) {
+      if ((args[used++] = expand(prog->text + prog->words[cmd->a + j], &bp, buf + sizeof(buf))) == NULL) {
+        fprintf(stderr, "run_shell: line too long\n");
+        return 2;
+      }
+    }
+    args[used++] = NULL;
+  }
+
+  if (pipe->b == 1 && (b = find_builtin(stages[0].argv[0])) != NULL)
+    return run_builtin(b, stages[0].argc, stages[0].argv);
+
+  fflush(stdout); // anything the shell printed goes before the children's output
+  if (run_commands(stages, pipe->b)) {
+    fprintf(stderr, "run_shell: syntax error\n");
+    return 2;
+  }
+  return last_status;
+}
+
+/* Function name: is_range
+ * Description: check whether a word is a range {A..B} of integers.
+ */
+static int is_range(const char *word, long *lo, long *hi)
+{
+  char *end;
+  if (word[0] != '{')
+    return 0;
+  *lo = strtol(word + 1, &end, 10);
+  if (end == word + 1 || strncmp(end, "..", 2) != 0)
+    return 0;
+  word = end + 2;
+  *hi = strtol(word, &end, 10);
+  return end != word && !strcmp(end, "}");
+}
+
+/* Function name: exec_for
+ * Description: run the body of a for loop once per word. Ranges are counted
+ *   through without building the word list.
+ * Return: exit status of the last iteration, 0 if there was none.
+ */
+static int exec_for(const struct program *prog, const struct node *loop)
+{
+  char value[EXEC_BUFSIZE];
+  struct var *v = make_var(prog->text + prog->words[loop->a]);
+  int i, status = 0;
+
+  if (v == NULL)
+    return 2;
+  for (i = 0; i < loop->c && !shell_exit; i++) {
+    const char *word = prog->text + prog->words[loop->b + i];
+    long lo, hi, cur;
+
+    if (is_range(word, &lo, &hi)) {
+      for (cur = lo; !shell_exit; cur += lo <= hi ? 1 : -1) {
+        snprintf(value, sizeof(value), "%ld", cur);
+        if (assign_var(v, value) < 0)
+          return 2;
+        status = exec_node(prog, loop->d);
+        if (cur == hi)
+          break;
+      }
+    } else {
+      char *bp = value, *w = expand(word, &bp, value + sizeof(value));
+      if (w == NULL || assign_var(v, w) < 0)
+        return 2;
+      status = exec_node(prog, loop->d);
+    }
+  }
+  return status;
+}
+
+/* Function name: exec_node
+ * Description: run one node of a program.
+ * Return: exit status, which is also stored in last_status.
+ */
+static int exec_node(const struct program *prog, int n)
+{
+  const struct node *node = &prog->nodes[n];
+  int status = 0;
+
+  switch (node->type) {
+  case N_PIPE:
+    status = exec_pipeline(prog, node);
+    break;
+  case N_SEQ:
+    status = exec_node(prog, node->a);
+    if (!shell_exit)
+      status = exec_node(prog, node->b);
+    break;
+  case N_AND:
+    status = exec_node(prog, node->a);
+    if (status == 0 && !shell_exit)
+      status = exec_node(prog, node->b);
+    break;
+  case N_OR:
+    status = exec_node(prog, node->a);
+    if (status != 0 && !shell_exit)
+      status = exec_node(prog, node->b);
+    break;
+  case N_IF:
+    if (exec_node(prog, node->a) == 0) {
+      if (!shell_exit)
+        status = exec_node(prog, node->b);
+    } else if (node->c >= 0 && !shell_exit)
+      status = exec_node(prog, node->c);
+    break;
+  case N_WHILE:
+  case N_UNTIL:
+    while (!shell_exit) {
+      int cond = exec_node(prog, node->a);
+      if (shell_exit || (cond == 0) != (node->type == N_WHILE))
+        break;
+      status = exec_node(prog, node->b);
+    }
+    break;
+  case N_FOR:
+    status = exec_for(prog, node);
+    break;
+  }
+  last_status = status;
+  return status;
+}
+
+/* Function name: exec_program
+ * Description: run a program, see exec.h.
+ */
+int exec_program(const struct program *prog)
+{
+  if (prog->root < 0)
+    return last_status;
+  return exec_node(prog, prog->root);
+}
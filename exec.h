@@ -0,0 +1,94 @@
+/*  File name: exec.h
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#ifndef exec_h
+#define exec_h
+
+/*
+ * A line is parsed into a program: a flat array of nodes that refer to each
+ * other, to the word list and to the text pool by index only. A program is
+ * therefore relocatable and is stored as is by the script cache (cache.c).
+ * Children always come before their parent in the node array.
+ *
+ * Grammar (one line):
+ *   list     := and_or (';' and_or)* [';']
+ *   and_or   := pipeline (('&&' | '||') pipeline)*
+ *   pipeline := command ('|' command)* | compound
+ *   compound := 'if' list 'then' list ('elif' list 'then' list)* ['else' list] 'fi'
+ *             | 'while' list 'do' list 'done' | 'until' list 'do' list 'done'
+ *             | 'for' NAME 'in' word* ';' 'do' list 'done'
+ *   command  := word+
+ */
+
+/* Node types */
+#define N_PIPE 1   /* a: first N_CMD node, b: number of commands */
+#define N_CMD 2    /* a: first word, b: number of words */
+#define N_SEQ 3    /* a; b */
+#define N_AND 4    /* a && b */
+#define N_OR 5     /* a || b */
+#define N_IF 6     /* if a then b else c (c is -1 if there is no else) */
+#define N_WHILE 7  /* while a do b */
+#define N_UNTIL 8  /* until a do b */
+#define N_FOR 9    /* for word a in words b .. b+c-1 do d */
+
+struct node {
+  int type;
+  int a, b, c, d;
+};
+
+struct program {
+  struct node *nodes;
+  int nnodes;
+  int *words;      /* offset of every word in text */
+  int nwords;
+  char *text;      /* the words, NUL-terminated */
+  int textlen;
+  int root;        /* node to run, -1 for an empty line */
+};
+
+/* Exit status of the last command, as $? */
+extern int last_status;
+
+/* Set by the exit builtin; stops every running list and loop */
+extern int shell_exit;
+
+/* Function name: parse_program
+ * Description: Parse a line into a program.
+ * Parameters:
+ *   line, the line, terminated with '\n' or a 0 byte. It is not modified.
+ *   prog, receives the program, to be released with free_program().
+ * Output:
+ *   Returns 0 on success, -1 on syntax error (nothing to free then).
+ */
+int parse_program(const char *line, struct program *prog);
+
+/* Function name: free_program
+ * Description: Release a program built by parse_program.
+ */
+void free_program(struct program *prog);
+
+/* Function name: check_program
+ * Description: Check that a program read from outside (the script cache)
+ *   only refers to nodes, words and text it contains.
+ * Output:
+ *   Returns 0 if the program is well formed, -1 otherwise.
+ */
+int check_program(const struct program *prog);
+
+/* Function name: exec_program
+ * Description: Run a program. Lists, conditionals and loops are evaluated by
+ *   the shell itself; builtins run without forking and reuse preallocated
+ *   argv storage, so only external commands cost a process.
+ *   Words are expanded for $NAME, ${NAME} and $?, where NAME is a shell
+ *   variable (set by for and read) or else an environment variable. A for
+ *   word of the form {A..B} counts from A to B without being expanded first.
+ *   The program is only read, so it may live in read-only memory.
+ * Output:
+ *   Returns the exit status of the last command run.
+ */
+int exec_program(const struct program *prog);
+
+#endif /* exec_h */
@@ -0,0 +1,510 @@
+/*  File name: joblog.c
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "joblog.h"
+#include "util.h"
+
+/*
+ * Every recorded job owns a file made of one header page followed by the
+ * ring. The shell maps the file shared; the recorder process inherits that
+ * mapping across fork() and bumps head->written after every chunk it stores,
+ * so the shell can replay the ring without talking to the recorder.
+ */
+
+#define JOBLOG_RING (64 * 1024)    /* Default ring size per job */
+#define JOBLOG_BUDGET (1024 * 1024) /* Default total size of all rings */
+#define JOBLOG_HDR 4096             /* The ring starts on its own page */
+#define JOBLOG_CHUNK 65536          /* Largest chunk moved at once (a pipe's capacity) */
+#define JOBLOG_CMDLEN 64
+#define JOBLOG_PATHLEN 256
+
+struct ring_head {
+  uint64_t written; // bytes written since the job started; the ring holds the last size of them
+  uint64_t size;    // size of the ring
+};
+
+struct job {
+  int id;
+  pid_t pid;         // the job itself
+  pid_t recorder;    // the recorder process
+  char *map;         // header page and ring, NULL once the job is evicted
+  size_t size;       // size of the ring
+  int wfd[2];        // shell's copy of the pipes' write ends, until joblog_started
+  char path[JOBLOG_PATHLEN + 16];
+  char cmd[JOBLOG_CMDLEN];
+  struct job *next;
+};
+
+static int recording = 0;
+static size_t ring_size = JOBLOG_RING;
+static size_t budget = JOBLOG_BUDGET;
+static size_t in_use = 0;          // total size of the rings still kept
+static int next_id = 1;
+static struct job *jobs = NULL;    // oldest first
+static char logdir[JOBLOG_PATHLEN];
+static pid_t owner = 0;            // the shell; forked children inherit the atexit handler
+static char buf[JOBLOG_CHUNK];     // only used where splice() is not available
+
+/* Function name: ring_copy
+ * Description: store a buffer in the ring (recorder side, copying fallback).
+ */
+static void ring_copy(int ringfd, struct ring_head *head, const char *data, size_t len)
+{
+  while (len > 0) {
+    size_t pos = head->written % head->size;
+    size_t chunk = len < head->size - pos ? len : head->size - pos;
+    ssize_t n = pwrite(ringfd, data, chunk, JOBLOG_HDR + pos);
+    if (n <= 0)
+      return;
+    head->written += n;
+    data += n;
+    len -= n;
+  }
+}
+
+#ifdef __linux__
+/* Function name: ring_splice
+ * Description: move len bytes from a pipe into the ring without copying them.
+ * Return: 0 on success, -1 if splice() cannot write the ring file.
+ */
+static int ring_splice(int from, int ringfd, struct ring_head *head, size_t len)
+{
+  while (len > 0) {
+    size_t pos = head->written % head->size;
+    size_t chunk = len < head->size - pos ? len : head->size - pos;
+    loff_t off = JOBLOG_HDR + pos;
+    ssize_t n = splice(from, NULL, ringfd, &off, chunk, SPLICE_F_MOVE);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    head->written += n;
+    len -= n;
+  }
+  return 0;
+}
+#endif
+
+/* Function name: record_chunk
+ * Description: pass one chunk of a job's output on to the terminal and keep a
+ *   copy of it in the ring. On Linux the chunk is duplicated with tee() into
+ *   a spare pipe and spliced from there into the ring file, and the original
+ *   is spliced on to the terminal. Falls back to read()/write() whenever a
+ *   descriptor does not support that.
+ * Parameters:
+ *   in: read end of the job's pipe.
+ *   term: where the output would have gone without recording.
+ *   spare: spare pipe for tee(), or {-1, -1} to copy through user space.
+ *   ringfd, head: the job's ring.
+ * Return: bytes handled, 0 at end of file, -1 on error.
+ */
+static ssize_t record_chunk(int in, int term, int spare[2], int ringfd, struct ring_head *head)
+{
+  ssize_t n;
+#ifdef __linux__
+  static int term_splice = 1;
+  if (spare[0] >= 0) {
+    n = tee(in, spare[1], JOBLOG_CHUNK, 0);
+    if (n < 0 && errno == EINTR)
+      return 1;
+    if (n < 0 && errno == EINVAL) { /* Not pipes after all: copy instead */
+      spare[0] = spare[1] = -1;
+      return record_chunk(in, term, spare, ringfd, head);
+    }
+    if (n <= 0)
+      return n;
+    if (ring_splice(spare[0], ringfd, head, n) < 0) { /* Drain the spare pipe by hand */
+      size_t left = n;
+      while (left > 0) {
+        ssize_t m = read(spare[0], buf, left);
+        if (m <= 0)
+          break;
+        ring_copy(ringfd, head, buf, m);
+        left -= m;
+      }
+    }
+    size_t left = n;
+    while (left > 0 && term_splice) {
+      ssize_t m = splice(in, NULL, term, NULL, left, SPLICE_F_MOVE);
+      if (m < 0 && errno == EINTR)
+        continue;
+      if (m <= 0) {
+        term_splice = 0; // e.g. a terminal that cannot be spliced to
+        break;
+      }
+      left -= m;
+    }
+    while (left > 0) {
+      ssize_t m = read(in, buf, left);
+      if (m <= 0)
+        return -1;
+      write_all(term, buf, m);
+      left -= m;
+    }
+    return n;
+  }
+#endif
+  n = read(in, buf, sizeof(buf));
+  if (n < 0 && errno == EINTR)
+    return 1;
+  if (n > 0) {
+    write_all(term, buf, n);
+    ring_copy(ringfd, head, buf, n);
+  }
+  return n;
+}
+
+/* Function name: recorder
+ * Description: body of the recorder process: copy the job's stdout and
+ *   stderr until both reach end of file. Never returns.
+ * Parameters:
+ *   in: read ends of the job's stdout and stderr pipes (-1 if not recorded).
+ *   ringfd, head: the job's ring.
+ */
+static void recorder(int in[2], int ringfd, struct ring_head *head)
+{
+  int term[2] = { STDOUT_FILENO, STDERR_FILENO };
+  int spare[2] = { -1, -1 };
+  struct pollfd pfd[2];
+  struct rlimit lim;
+  int i, fd;
+
+  /* Drop the shell's other descriptors (e.g. coprocess pipes, whose
+   * readers would otherwise never see end of file) */
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+    for (fd = STDERR_FILENO + 1; fd < (int)lim.rlim_cur; fd++)
+      if (fd != in[0] && fd != in[1] && fd != ringfd)
+        close(fd);
+  }
+
+  signal(SIGPIPE, SIG_IGN); // a closed terminal must not stop the recording
+  signal(SIGTSTP, SIG_IGN);
+#ifdef __linux__
+  if (pipe(spare) < 0)
+    spare[0] = spare[1] = -1;
+#endif
+
+  while (in[0] >= 0 || in[1] >= 0) {
+    for (i = 0; i < 2; i++) {
+      pfd[i].fd = in[i];
+      pfd[i].events = POLLIN;
+      pfd[i].revents = 0;
+    }
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (i = 0; i < 2; i++) {
+      if (in[i] >= 0 && pfd[i].revents && record_chunk(in[i], term[i], spare, ringfd, head) <= 0) {
+        close(in[i]);
+        in[i] = -1;
+      }
+    }
+  }
+  _exit(0);
+}
+
+/* Function name: drop_job
+ * Description: release the ring of a job. The entry stays in the list until
+ *   its recorder has been reaped.
+ */
+static void drop_job(struct job *job)
+{
+  if (job->map == NULL)
+    return;
+  munmap(job->map, JOBLOG_HDR + job->size);
+  unlink(job->path);
+  job->map = NULL;
+  in_use -= job->size;
+}
+
+/* Function name: joblog_cleanup
+ * Description: remove every ring file when the shell exits. A child that
+ *   calls exit() (e.g. after a failed exec) leaves them alone.
+ */
+static void joblog_cleanup(void)
+{
+  struct job *job;
+  if (getpid() != owner)
+    return;
+  for (job = jobs; job != NULL; job = job->next)
+    drop_job(job);
+  if (logdir[0])
+    rmdir(logdir);
+}
+
+/* Function name: joblog_dir
+ * Description: create the directory holding the ring files of this shell.
+ *   It gets an unpredictable name from mkdtemp(), mode 0700, so in a shared
+ *   /tmp no other user can create it first or plant files in it.
+ * Return: 0 on success, -1 on error.
+ */
+static int joblog_dir(void)
+{
+  if (logdir[0])
+    return 0;
+  const char *base = getenv("XDG_RUNTIME_DIR");
+  if (base == NULL || base[0] != '/')
+    base = "/tmp";
+  if (snprintf(logdir, sizeof(logdir), "%s/mysh-joblog-XXXXXX", base) >= (int)sizeof(logdir)
+      || mkdtemp(logdir) == NULL) {
+    logdir[0] = '\0';
+    return -1;
+  }
+  owner = getpid();
+  atexit(joblog_cleanup);
+  return 0;
+}
+
+/* Function name: joblog_open
+ * Description: set up the ring and recorder of a new background job.
+ * Return: job id, or 0 if the job is not recorded.
+ */
+int joblog_open(char *cmd[], int *fd_out, int *fd_err)
+{
+  int capture[2] = { *fd_out == STDOUT_FILENO, *fd_err == STDERR_FILENO };
+  int rfd[2] = { -1, -1 };
+  struct job *job, **tail;
+  int i;
+
+  if (!recording || (!capture[0] && !capture[1]))
+    return 0;
+  if (joblog_dir() < 0) {
+    perror("run_shell: joblog");
+    return 0;
+  }
+
+  /* Evict the oldest finished jobs until the new ring fits the budget. The
+   * ring of a running job stays mapped in its recorder, so evicting it would
+   * not free anything. */
+  for (job = jobs; job != NULL && in_use + ring_size > budget; job = job->next) {
+    if (job->recorder > 0 && waitpid(job->recorder, NULL, WNOHANG) == job->recorder)
+      job->recorder = 0;
+    if (job->recorder == 0)
+      drop_job(job);
+  }
+  for (tail = &jobs; (job = *tail) != NULL; ) { /* Free evicted jobs that are already reaped */
+    if (job->map == NULL && job->recorder == 0) {
+      *tail = job->next;
+      free(job);
+    } else
+      tail = &job->next;
+  }
+
+  if (in_use + ring_size > budget) {
+    fprintf(stderr, "run_shell: joblog: budget in use by running jobs, job not recorded\n");
+    return 0;
+  }
+
+  if ((job = calloc(1, sizeof(struct job))) == NULL) {
+    perror("run_shell: joblog");
+    return 0;
+  }
+  job->id = next_id;
+  job->size = ring_size;
+  job->wfd[0] = job->wfd[1] = -1;
+  snprintf(job->path, sizeof(job->path), "%s/job%d", logdir, job->id);
+  for (i = 0; cmd[i] != NULL; i++) {
+    size_t used = strlen(job->cmd);
+    snprintf(job->cmd + used, sizeof(job->cmd) - used, "%s%s", i ? " " : "", cmd[i]);
+  }
+
+  int ringfd = open(job->path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+  if (ringfd < 0 || ftruncate(ringfd, JOBLOG_HDR + job->size) < 0
+      || (job->map = mmap(NULL, JOBLOG_HDR + job->size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, ringfd, 0)) == MAP_FAILED) {
+    perror("run_shell: joblog");
+    if (ringfd >= 0) {
+      close(ringfd);
+      unlink(job->path);
+    }
+    free(job);
+    return 0;
+  }
+  struct ring_head *head = (struct ring_head *)job->map;
+  head->size = job->size;
+
+  for (i = 0; i < 2; i++) {
+    int p[2];
+    if (capture[i] && pipe(p) == 0) {
+      rfd[i] = p[0];
+      job->wfd[i] = p[1];
+    }
+  }
+
+  if ((job->recorder = fork()) == 0) {
+    for (i = 0; i < 2; i++)
+      if (job->wfd[i] >= 0)
+        close(job->wfd[i]);
+    recorder(rfd, ringfd, head);
+  }
+  close(ringfd);
+  for (i = 0; i < 2; i++)
+    if (rfd[i] >= 0)
+      close(rfd[i]);
+#ifdef MADV_DONTFORK
+  /* Later recorders must not inherit this ring, or it would stay allocated
+   * after its job is evicted */
+  madvise(job->map, JOBLOG_HDR + job->size, MADV_DONTFORK);
+#endif
+  if (job->recorder < 0) {
+    perror("run_shell: joblog");
+    for (i = 0; i < 2; i++)
+      if (job->wfd[i] >= 0)
+        close(job->wfd[i]);
+    munmap(job->map, JOBLOG_HDR + job->size);
+    unlink(job->path);
+    free(job);
+    return 0;
+  }
+
+  if (job->wfd[0] >= 0)
+    *fd_out = job->wfd[0];
+  if (job->wfd[1] >= 0)
+    *fd_err = job->wfd[1];
+  in_use += job->size;
+  next_id++;
+  for (tail = &jobs; *tail != NULL; tail = &(*tail)->next);
+  *tail = job;
+  return job->id;
+}
+
+/* Function name: find_job
+ * Description: look up a job by id.
+ */
+static struct job *find_job(int id)
+{
+  struct job *job;
+  for (job = jobs; job != NULL && job->id != id; job = job->next);
+  return job;
+}
+
+/* Function name: joblog_started
+ * Description: close the shell's write ends once the job holds them.
+ */
+void joblog_started(int id, pid_t pid)
+{
+  struct job *job = find_job(id);
+  int i;
+  if (id == 0 || job == NULL)
+    return;
+  for (i = 0; i < 2; i++) {
+    if (job->wfd[i] >= 0)
+      close(job->wfd[i]);
+    job->wfd[i] = -1;
+  }
+  job->pid = pid;
+  if (pid > 0)
+    printf("[%d] %d\n", id, pid);
+}
+
+/* Function name: joblog_reaped
+ * Description: forget a finished recorder; evicted jobs are freed here.
+ */
+int joblog_reaped(pid_t pid)
+{
+  struct job **link, *job;
+  for (link = &jobs; (job = *link) != NULL; link = &job->next) {
+    if (job->recorder != pid)
+      continue;
+    job->recorder = 0;
+    if (job->map == NULL) {
+      *link = job->next;
+      free(job);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+/* Function name: replay
+ * Description: write out what a job's ring holds, oldest byte first.
+ */
+static void replay(struct job *job)
+{
+  struct ring_head *head = (struct ring_head *)job->map;
+  char *ring = job->map + JOBLOG_HDR;
+  uint64_t written = head->written;
+  size_t start = written > job->size ? written % job->size : 0;
+
+  fflush(stdout);
+  if (written > job->size) {
+    printf("[%d] ... %llu earlier bytes dropped\n", job->id,
+           (unsigned long long)(written - job->size));
+    fflush(stdout);
+    write_all(STDOUT_FILENO, ring + start, job->size - start);
+    write_all(STDOUT_FILENO, ring, start);
+  } else
+    write_all(STDOUT_FILENO, ring, written);
+}
+
+/* Function name: shell_joblog
+ * Description: the joblog builtin, see joblog.h.
+ */
+int shell_joblog(char *arg)
+{
+  char *argv[5];
+  int argc = tokenize(arg, argv, 4);
+  struct job *job;
+
+  if (argc == 1) { /* List the jobs */
+    printf("recording %s, ring %zu bytes, budget %zu bytes\n", recording ? "on" : "off",
+           ring_size, budget);
+    for (job = jobs; job != NULL; job = job->next) {
+      if (job->map != NULL)
+        printf("[%d] %d %llu bytes  %s\n", job->id, job->pid,
+               (unsigned long long)((struct ring_head *)job->map)->written, job->cmd);
+    }
+    return 0;
+  }
+  if (!strcmp(argv[1], "on") && argc <= 4) {
+    size_t ring = argc > 2 ? parse_size(argv[2]) : ring_size;
+    size_t total = argc > 3 ? parse_size(argv[3]) : budget;
+    if (ring == 0 || total < ring) {
+      fprintf(stderr, "joblog: ring size must be non-zero and within the budget\n");
+      return -1;
+    }
+    ring_size = ring;
+    budget = total;
+    recording = 1;
+    return 0;
+  }
+  if (!strcmp(argv[1], "off") && argc == 2) {
+    recording = 0;
+    return 0;
+  }
+  char *end;
+  long id = strtol(argv[1], &end, 10);
+  if (argc == 2 && *end == '\0' && id > 0) {
+    job = find_job(id);
+    if (job == NULL || job->map == NULL) {
+      fprintf(stderr, "joblog: no log for job %s\n", argv[1]);
+      return -1;
+    }
+    replay(job);
+    return 0;
+  }
+  fprintf(stderr, "usage: joblog [on [ringsize [budget]] | off | <id>]\n");
+  return -1;
+}
@@ -0,0 +1,67 @@
+/*  File name: joblog.h
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#ifndef joblog_h
+#define joblog_h
+
+#include <sys/types.h>
+
+/* Function name: shell_joblog
+ * Description: The joblog builtin.
+ *   joblog on [ringsize [budget]]  record the output of background jobs
+ *   joblog off                     stop recording new jobs
+ *   joblog                         list the recorded jobs
+ *   joblog <id>                    replay what job <id> wrote
+ *   Sizes take an optional K, M or G suffix.
+ *
+ * Parameters:
+ *   arg, the whole input line, terminated with '\n'.
+ * Output:
+ *   Returns 0 on success, -1 on error.
+ */
+int shell_joblog(char *arg);
+
+/* Function name: joblog_open
+ * Description: Start recording a background job that is about to be spawned.
+ *   If recording is on and the job's stdout or stderr still goes to the
+ *   shell's own stdout/stderr, those descriptors are replaced with a pipe
+ *   read by a recorder process. The recorder passes the output on unchanged
+ *   and copies it into a fixed-size ring buffer in a memory-mapped file,
+ *   using tee()/splice() so the data is never copied through user space.
+ *   When the ring buffers would exceed the memory budget, the oldest
+ *   finished jobs are dropped first; if running jobs alone fill the budget,
+ *   the new job is not recorded.
+ *
+ * Parameters:
+ *   cmd, array of arguments of the job, used to describe it in the listing.
+ *   fd_out, pointer to the job's stdout; replaced if it is recorded.
+ *   fd_err, pointer to the job's stderr; replaced if it is recorded.
+ * Output:
+ *   Returns the job id, or 0 if the job is not recorded.
+ * Error handling:
+ *   On any error a message is printed and the job runs unrecorded.
+ */
+int joblog_open(char *cmd[], int *fd_out, int *fd_err);
+
+/* Function name: joblog_started
+ * Description: Finish joblog_open once the job has been spawned: closes the
+ *   shell's copy of the pipe and records the job's PID.
+ * Parameters:
+ *   id, job id returned by joblog_open (0 is ignored).
+ *   pid, PID of the job, or -1 if it could not be spawned.
+ */
+void joblog_started(int id, pid_t pid);
+
+/* Function name: joblog_reaped
+ * Description: Tell whether a reaped child was one of the recorder processes.
+ * Parameters:
+ *   pid, PID returned by waitpid.
+ * Output:
+ *   Returns 1 for a recorder, 0 otherwise.
+ */
+int joblog_reaped(pid_t pid);
+
+#endif /* joblog_h */
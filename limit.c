@@ -0,0 +1,338 @@
+/*  File name: limit.c
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "limit.h"
+#include "myshell.h"
+#include "util.h"
+
+#define LIMIT_PATHLEN 4096
+#define LIMIT_USAGE "usage: limit [--mem SIZE] [--cpu PCT%] [--pids N] cmd args...\n"
+#define CPU_PERIOD 100000 /* cpu.max period, in microseconds */
+
+static char base[LIMIT_PATHLEN]; // the shell's cgroup v2 directory; "" until looked up, "-" if none
+static int groups = 0;           // groups created so far, to name the next one
+static char leaf[64];            // the leaf group the shell moved itself into, if any
+static pid_t leaf_owner = 0;     // the shell, once it has moved into leaf
+static char enabled[64];         // controllers enabled by the shell, as "-memory -pids"
+
+/* Function name: find_base
+ * Description: look up the directory of the shell's own cgroup v2 group, from
+ *   the cgroup2 mount in /proc/self/mountinfo and the "0::" line of
+ *   /proc/self/cgroup. The answer is kept, since the shell may later move
+ *   itself into a leaf group below it.
+ * Return: the directory, or NULL if there is no cgroup v2 hierarchy.
+ */
+static const char *find_base(void)
+{
+  char line[LIMIT_PATHLEN], mnt[LIMIT_PATHLEN] = "";
+  FILE *fp;
+
+  if (base[0])
+    return strcmp(base, "-") ? base : NULL;
+  strcpy(base, "-");
+
+  if ((fp = fopen("/proc/self/mountinfo", "r")) == NULL)
+    return NULL;
+  while (fgets(line, sizeof(line), fp)) {
+    /* id parent major:minor root mountpoint options ... - fstype source options */
+    if (strstr(line, " - cgroup2 ") && sscanf(line, "%*s %*s %*s %*s %4095s", mnt) == 1)
+      break;
+    mnt[0] = '\0';
+  }
+  fclose(fp);
+  if (mnt[0] == '\0' || (fp = fopen("/proc/self/cgroup", "r")) == NULL)
+    return NULL;
+  while (fgets(line, sizeof(line), fp)) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      if (snprintf(base, sizeof(base), "%s%s", mnt, strcmp(line + 3, "/") ? line + 3 : "")
+          >= (int)sizeof(base))
+        strcpy(base, "-");
+      break;
+    }
+  }
+  fclose(fp);
+  return strcmp(base, "-") ? base : NULL;
+}
+
+/* Function name: write_file
+ * Description: write a string to a file in a cgroup directory.
+ * Return: 0 on success, -1 on error (errno is set).
+ */
+static int write_file(int dirfd, const char *name, const char *text)
+{
+  int fd = openat(dirfd, name, O_WRONLY);
+  if (fd < 0)
+    return -1;
+  ssize_t n = write(fd, text, strlen(text));
+  int err = errno;
+  close(fd);
+  errno = err;
+  return n == (ssize_t)strlen(text) ? 0 : -1;
+}
+
+/* Function name: read_file
+ * Description: read a small file in a cgroup directory.
+ * Return: 0 on success, -1 on error.
+ */
+static int read_file(int dirfd, const char *name, char *buf, size_t size)
+{
+  int fd = openat(dirfd, name, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  ssize_t n = read(fd, buf, size - 1);
+  close(fd);
+  if (n < 0)
+    return -1;
+  buf[n] = '\0';
+  return 0;
+}
+
+/* Function name: stat_value
+ * Description: value of "key value" in a flat keyed file such as cpu.stat.
+ * Return: the value, or 0 if the key is missing.
+ */
+static unsigned long long stat_value(const char *text, const char *key)
+{
+  size_t len = strlen(key);
+  const char *p;
+  for (p = text; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL) {
+    if (strncmp(p, key, len) == 0 && p[len] == ' ')
+      return strtoull(p + len + 1, NULL, 10);
+  }
+  return 0;
+}
+
+/* Function name: leave_leaf
+ * Description: at exit, undo enable_controller: hand the controllers back,
+ *   move the shell back to its own group and remove the leaf group. Forked
+ *   children inherit the handler and leave everything alone.
+ */
+static void leave_leaf(void)
+{
+  char text[32];
+  int basefd;
+
+  if (getpid() != leaf_owner || (basefd = open(base, O_RDONLY | O_DIRECTORY)) < 0)
+    return;
+  if (enabled[0])
+    write_file(basefd, "cgroup.subtree_control", enabled);
+  snprintf(text, sizeof(text), "%ld", (long)getpid());
+  if (write_file(basefd, "cgroup.procs", text) == 0)
+    unlinkat(basefd, leaf, AT_REMOVEDIR); // fails while background jobs still run in it
+  close(basefd);
+}
+
+/* Function name: enable_controller
+ * Description: make a controller available to the groups below the shell's.
+ *   A group that holds processes cannot hand controllers down (EBUSY), so if
+ *   the shell is the only process in its group it first moves itself into a
+ *   leaf group of its own, which is removed again when the shell exits.
+ * Return: 0 on success, -1 on error.
+ */
+static int enable_controller(int basefd, const char *name)
+{
+  char text[32], buf[512], *end;
+
+  snprintf(text, sizeof(text), "+%s", name);
+  if (write_file(basefd, "cgroup.subtree_control", text) < 0) {
+    if (errno != EBUSY || leaf_owner)
+      return -1;
+    /* Moving out only helps if nobody else (e.g. the parent shell) is left behind */
+    if (read_file(basefd, "cgroup.procs", buf, sizeof(buf)) < 0
+        || strtol(buf, &end, 10) != (long)getpid() || strcmp(end, "\n"))
+      return -1;
+    snprintf(leaf, sizeof(leaf), "mysh-%ld-shell", (long)getpid());
+    if (mkdirat(basefd, leaf, 0755) < 0)
+      return -1;
+    snprintf(buf, sizeof(buf), "%s/cgroup.procs", leaf);
+    snprintf(text, sizeof(text), "%ld", (long)getpid());
+    if (write_file(basefd, buf, text) < 0) {
+      unlinkat(basefd, leaf, AT_REMOVEDIR);
+      return -1;
+    }
+    leaf_owner = getpid();
+    atexit(leave_leaf);
+    snprintf(text, sizeof(text), "+%s", name);
+    if (write_file(basefd, "cgroup.subtree_control", text) < 0)
+      return -1;
+  }
+  /* Remember it as "-name", to hand it back in leave_leaf */
+  size_t len = strlen(enabled);
+  snprintf(enabled + len, sizeof(enabled) - len, "%s-%s", len ? " " : "", name);
+  return 0;
+}
+
+/* Function name: set_limit
+ * Description: set one limit file of the job's group, enabling its
+ *   controller first if need be.
+ * Return: 0 on success, -1 if the group cannot enforce the limit.
+ */
+static int set_limit(int basefd, int groupfd, const char *controller, const char *file,
+                     const char *value)
+{
+  if (faccessat(groupfd, file, W_OK, 0) < 0
+      && (enable_controller(basefd, controller) < 0 || faccessat(groupfd, file, W_OK, 0) < 0))
+    return -1;
+  return write_file(groupfd, file, value);
+}
+
+/* Function name: print_size
+ * Description: print a byte count in a readable unit.
+ */
+static void print_size(unsigned long long bytes)
+{
+  if (bytes >= 1 << 30)
+    printf("%.1f GiB", bytes / (double)(1 << 30));
+  else if (bytes >= 1 << 20)
+    printf("%.1f MiB", bytes / (double)(1 << 20));
+  else
+    printf("%.1f KiB", bytes / 1024.0);
+}
+
+/* Function name: report
+ * Description: print what the job used, from its group's statistics.
+ */
+static void report(int groupfd)
+{
+  char buf[1024];
+  unsigned long long val;
+
+  if (read_file(groupfd, "cpu.stat", buf, sizeof(buf)) == 0) {
+    printf("limit: cpu %.3f s (user %.3f s, sys %.3f s)", stat_value(buf, "usage_usec") / 1e6,
+           stat_value(buf, "user_usec") / 1e6, stat_value(buf, "system_usec") / 1e6);
+    if ((val = stat_value(buf, "nr_periods")) > 0)
+      printf(", throttled %llu of %llu periods for %.3f s", stat_value(buf, "nr_throttled"),
+             val, stat_value(buf, "throttled_usec") / 1e6);
+  } else
+    printf("limit: no cpu statistics");
+  if (read_file(groupfd, "memory.peak", buf, sizeof(buf)) == 0) {
+    printf(", peak memory ");
+    print_size(strtoull(buf, NULL, 10));
+  }
+  if (read_file(groupfd, "pids.peak", buf, sizeof(buf)) == 0)
+    printf(", peak pids %llu", strtoull(buf, NULL, 10));
+  printf("\n");
+}
+
+/* Function name: shell_limit
+ * Description: the limit builtin, see limit.h.
+ */
+int shell_limit(char *arg)
+{
+  struct child_limits lim = { -1, RLIM_INFINITY };
+  size_t mem = 0;
+  double cpu = 0;
+  long pids = 0;
+  char *p = arg + strlen("limit");
+
+  /* Parse options; whatever follows them is the command line */
+  for (;;) {
+    char *opt, *val, *end;
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (strncmp(p, "--", 2) != 0)
+      break;
+    opt = p;
+    p += strcspn(p, " \t\n");
+    while (*p == ' ' || *p == '\t')
+      p++;
+    val = p;
+    p += strcspn(p, " \t\n");
+    if (*p)
+      *p++ = '\0';
+    if (strncmp(opt, "--mem ", 6) == 0 && (mem = parse_size(val)) > 0)
+      continue;
+    if (strncmp(opt, "--cpu ", 6) == 0 && (cpu = strtod(val, &end)) > 0
+        && (*end == '\0' || !strcmp(end, "%")))
+      continue;
+    if (strncmp(opt, "--pids ", 7) == 0 && (pids = strtol(val, &end, 10)) > 0 && *end == '\0')
+      continue;
+    fputs(LIMIT_USAGE, stderr);
+    return -1;
+  }
+  if (*p == '\0' || *p == '\n') {
+    fputs(LIMIT_USAGE, stderr);
+    return -1;
+  }
+  /* The report and the removal of the group wait for the job, so it cannot run in the background */
+  char *word;
+  for (word = p; *(word += strspn(word, " \t\n")); word += strcspn(word, " \t\n")) {
+    if (word[0] == '&' && (word[1] == '\0' || strchr(" \t\n", word[1]))) {
+      fprintf(stderr, "limit: background jobs (&) cannot be limited\n");
+      return -1;
+    }
+  }
+
+  /* Create the job's group */
+  const char *dir = find_base();
+  char name[64], value[64];
+  int basefd = dir ? open(dir, O_RDONLY | O_DIRECTORY) : -1;
+  snprintf(name, sizeof(name), "mysh-%ld-%d", (long)getpid(), ++groups);
+  if (basefd >= 0 && mkdirat(basefd, name, 0755) == 0)
+    lim.cgroup_fd = openat(basefd, name, O_RDONLY | O_DIRECTORY);
+  if (lim.cgroup_fd < 0)
+    fprintf(stderr, "limit: no delegated cgroup v2 group, falling back to setrlimit\n");
+
+  if (mem) {
+    snprintf(value, sizeof(value), "%zu", mem);
+    if (lim.cgroup_fd < 0 || set_limit(basefd, lim.cgroup_fd, "memory", "memory.max", value) < 0)
+      lim.mem = mem;
+  }
+  if (pids) {
+    snprintf(value, sizeof(value), "%ld", pids);
+    /* No fallback: RLIMIT_NPROC counts every process of the user, not the job's */
+    if (lim.cgroup_fd < 0 || set_limit(basefd, lim.cgroup_fd, "pids", "pids.max", value) < 0)
+      fprintf(stderr, "limit: pids controller not available, --pids ignored\n");
+  }
+  if (cpu > 0) {
+    snprintf(value, sizeof(value), "%ld %d", (long)(cpu / 100 * CPU_PERIOD), CPU_PERIOD);
+    if (lim.cgroup_fd < 0 || set_limit(basefd, lim.cgroup_fd, "cpu", "cpu.max", value) < 0)
+      fprintf(stderr, "limit: cpu controller not available, --cpu ignored\n");
+  }
+  if (lim.cgroup_fd >= 0 && lim.mem != RLIM_INFINITY)
+    fprintf(stderr, "limit: memory controller not available, using setrlimit for --mem\n");
+
+  /* Run the job; run_child applies the limits to every process it spawns */
+  struct rusage ru_start, ru_end;
+  getrusage(RUSAGE_CHILDREN, &ru_start);
+  child_limits = &lim;
+  int ret = handle_line(p);
+  child_limits = NULL;
+  getrusage(RUSAGE_CHILDREN, &ru_end);
+
+  if (lim.cgroup_fd >= 0) {
+    report(lim.cgroup_fd);
+    close(lim.cgroup_fd);
+    if (unlinkat(basefd, name, AT_REMOVEDIR) < 0)
+      printf("limit: %s/%s still has processes, left in place\n", dir, name);
+  } else {
+    printf("limit: cpu user %.3f s, sys %.3f s\n",
+           (ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec)
+           + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec) / 1e6,
+           (ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec)
+           + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec) / 1e6);
+    if (basefd >= 0)
+      unlinkat(basefd, name, AT_REMOVEDIR);
+  }
+  if (basefd >= 0)
+    close(basefd);
+  if (ret)
+    fprintf(stderr, "run_shell: syntax error\n");
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+/*  File name: limit.h
+ *  Project name: project1
+ *  Author: Xintong Bao, Jingnong Wang
+ *  Date: 04/09/2017
+ */
+
+#ifndef limit_h
+#define limit_h
+
+/* Function name: shell_limit
+ * Description: The limit builtin.
+ *   limit [--mem SIZE] [--cpu PCT%] [--pids N] cmd args...
+ *   Runs the command line (a pipeline is fine) in a new cgroup v2 group
+ *   created under the shell's own cgroup, with memory.max, cpu.max and
+ *   pids.max set from the options. Every process of the job is spawned
+ *   straight into the group. When the job is done, its peak memory, CPU time
+ *   and CPU throttling are reported and the group is removed. The job must
+ *   run in the foreground: a command line containing '&' is refused.
+ *   Where the shell's cgroup is not delegated (or lacks a controller), the
+ *   limits fall back to setrlimit in the children: --mem sets RLIMIT_AS.
+ *   --cpu and --pids have no fallback (RLIMIT_NPROC would count every
+ *   process of the user, not those of the job) and are ignored with a warning.
+ *
+ * Parameters:
+ *   arg, the whole input line, terminated with '\n'.
+ * Output:
+ *   Returns 0 on success, -1 on usage error (including '&'), 1 on syntax
+ *   error in the command (after printing it).
+ */
+int shell_limit(char *arg);
+
+#endif /* limit_h */
@@ -4,19 +4,30 @@
  *  Date: 04/09/2017
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <ctype.h>
+#include <math.h>
 #include <dirent.h>
 #include <errno.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "cache.h"
+#include "coproc.h"
+#include "exec.h"
+#include "joblog.h"
+#include "limit.h"
 #include "myshell.h"
 #include "util.h"
 
@@ -26,27 +37,38 @@
 #define BUFSIZE 1024
 #define CMDNUMBER 100
 
+/* Defaults for the bench command */
+#define BENCH_RUNS 10
+#define BENCH_WARMUP 1
+
 /*
  * Implementation of a shell. Command-line input is grabbed with fgets, and
- * parsed by handle_line. handle_line parses input into 'command chunks', which
- * each represent a single command (with arguments) in the pipeline. Piping is
- * then handled in handle_line. Commands are executed in start_prog, which tests
- * for syntax errors, calls run_child, and waits on the child if necessary.
+ * run by run_line. handle_line parses input into a program (exec.c) made of
+ * 'command chunks', which each represent a single command (with arguments) in
+ * a pipeline, joined by lists, conditionals and loops that the shell evaluates
+ * itself. Builtins run in the shell; piping is handled in run_commands.
+ * Commands are executed in start_prog, which tests for syntax errors, calls
+ * run_child, and waits on the child if necessary.
+ * Scripts are run through the parse cache in cache.c, which stores the parsed
+ * program of every line so later runs skip parse_program.
  *
  */
 
+static void sigtstp_handler (int signo);
+
 pid_t child_pid = -127; // process id of the currently running child. -1 if there is no child.
 
 /*  Function name: main
- *  Description: main function of the program. Prompts user for command. If the command is "exit", the program is exited,
- *  otherwise the line is sent to handle_line() which makes
- *  calls to tokenize and attempt to run the appropriate command.
- *  If handle_line() returns non-zero, the user tries again.
+ *  Description: main function of the program. If a script path is given, the script is run
+ *  (through the parse cache) and the program exits. Otherwise prompts user for command.
+ *  Each line is sent to run_line(), which runs builtins itself and sends everything else
+ *  to handle_line() which makes calls to tokenize and attempt to run the appropriate command.
+ *  If the command is "exit", the program is exited, otherwise the user tries again.
  *  Parameter:
  *    argc: argument count.
  *    argv: argument array.
  *  Return:
- *    0 on success.
+ *    exit status of the last command.
  */
 int main(int argc, char *argv[])
 {
@@ -54,6 +76,10 @@ int main(int argc, char *argv[])
     fprintf(stderr, "Can't handle SIGINT\n");// Not handle ctrl + z
     exit(EXIT_FAILURE);
   }
+  signal(SIGPIPE, SIG_IGN); // echo >&NAME to a finished coprocess must fail, not kill the shell
+  
+  if (argc > 1) // mysh script: run every line of the script, then exit
+    return cache_run_script(argv[1]) ? EXIT_FAILURE : last_status;
   
   int status;         // Exit status of child
   int ret;            // Return value of waitpid
@@ -68,43 +94,18 @@ int main(int argc, char *argv[])
     ret = waitpid(-1, &status, WNOHANG); // pid = -1: wait for any child process. WNOHANG: if pid(-1) not finished, then return 0; if finished, return the child process' s pid.
     if (ret < 0 && errno != ECHILD) // ECHILD: no child process.
       perror("run_shell: main");
-    else if (ret > 0) // ret is the pid of finished child process.
+    else if (ret > 0 && !joblog_reaped(ret)) { // ret is the pid of finished child process. Recorders finish silently.
+      coproc_reaped(ret); // a coprocess helper that quit on its own
       printf("Child %d exited with status %d\n", ret, status);
+    }
     
     /* Display prompt */
     printf("[%s @ %s] ", getenv("USER"), hostname);
     
     /* get next command */
     if (fgets(line, MAXLEN, stdin)) {
-      if (!strcmp(line, "\n")) // strcmp: return 0 if str1 == str2.
-        continue; // Continue if the input is not a new line.
-      if (!strcmp(line, "exit\n"))
+      if (run_line(line))
         break; // break if input is exit.
-      if (!strcmp(line, "about\n")) {
-        printf("Name: Xintong Bao Student Id: 1230947\nName: Jingnong Wang Student Id: 1281672\n"); // about command
-        continue;
-      }
-      if (!strcmp(line, "clr\n")) {
-        shell_clear(); // clr command
-        continue;
-      }
-      if (strncmp(line, "dir ", 4) == 0) {
-        shell_dir(line); // dir command
-        continue;
-      }
-      if (!strcmp(line, "environ\n")) {
-        shell_env(); // environ command
-        continue;
-      }
-      if (!strcmp(line, "help\n")) {
-        shell_help(); // help command
-        continue;
-      }
-      if(strncmp(line, "cd ", 3) == 0){
-        shell_cd(line); // cd command
-      }
-      else if (handle_line(line)) // Attempt to run the command. Will get 0 on success, 1 on syntax error.
-        fprintf(stderr, "run_shell: syntax error\n");
     } else {
       if (errno && (errno != ECHILD)) {
         if (errno == EINTR) // EINTR: Interrupted system call
@@ -116,6 +117,53 @@ int main(int argc, char *argv[])
         break;
     }
   }
+  return last_status; // status of the last command, or the one given to exit
+}
+
+/*  Function name: is_line_builtin
+ *  Description: Check whether a line starts with a builtin that takes the rest of the
+ *  line as its command line (bench and limit), rather than being parsed by handle_line.
+ *  Parameters:
+ *    line: the user's input, terminated with '\n'.
+ *  Return:
+ *    1 if it does, 0 otherwise.
+ */
+int is_line_builtin(const char *line)
+{
+  return strncmp(line, "bench ", 6) == 0 || strncmp(line, "limit ", 6) == 0;
+}
+
+/*  Function name: run_line
+ *  Description: Run one line of input. bench and limit at the start of the line apply to
+ *  the rest of it; anything else goes to handle_line, which runs builtins (including exit)
+ *  in the shell.
+ *  Parameters:
+ *    line: the user's input, terminated with '\n'. The buffer is modified.
+ *  Return:
+ *    1 once the exit builtin has run, 0 otherwise.
+ */
+int run_line(char *line)
+{
+  if (strncmp(line, "bench ", 6) == 0) {
+    if (shell_bench(line)) // bench command; a failed run or a usage error fails it
+      last_status = 1;
+    return 0;
+  }
+  if (strncmp(line, "limit ", 6) == 0) {
+    shell_limit(line); // limit command
+    return 0;
+  }
+  if (handle_line(line)) // Attempt to run the command. Will get 0 on success, 1 on syntax error.
+    fprintf(stderr, "run_shell: syntax error\n");
+  return shell_exit;
+}
+
+/* Function name: shell_about
+ * Description: execute shell's about command.
+ */
+int shell_about()
+{
+  printf("Name: Xintong Bao Student Id: 1230947\nName: Jingnong Wang Student Id: 1281672\n");
   return 0;
 }
 
@@ -200,6 +248,179 @@ int shell_help()
   return 0;
 }
 
+/* Function name: elapsed_ms
+ * Description: milliseconds between two timestamps.
+ */
+static double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Function name: cpu_ms
+ * Description: user plus system time between two getrusage() samples, in ms.
+ *   The user and system parts are added to *user and *sys.
+ */
+static void cpu_ms(struct rusage *start, struct rusage *end, double *user, double *sys)
+{
+  *user += (end->ru_utime.tv_sec - start->ru_utime.tv_sec) * 1e3
+         + (end->ru_utime.tv_usec - start->ru_utime.tv_usec) / 1e3;
+  *sys += (end->ru_stime.tv_sec - start->ru_stime.tv_sec) * 1e3
+        + (end->ru_stime.tv_usec - start->ru_stime.tv_usec) / 1e3;
+}
+
+/* Function name: cmp_double
+ * Description: qsort comparator for doubles.
+ */
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Function name: percentile
+ * Description: nearest-rank percentile of a sorted array.
+ */
+static double percentile(double *sorted, int n, double p)
+{
+  int rank = (int)ceil(p / 100.0 * n);
+  if (rank < 1)
+    rank = 1;
+  return sorted[rank - 1];
+}
+
+/* Function name: t_critical
+ * Description: two-sided 95% critical value of Student's t for df degrees of freedom.
+ */
+static double t_critical(int df)
+{
+  static const double table[] = { /* df = 1 .. 30 */
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  if (df < 1)
+    return 0;
+  if (df <= 30)
+    return table[df - 1];
+  return 1.96;
+}
+
+/* Function name: shell_bench
+ * Description: run a command (or pipeline) repeatedly through handle_line and
+ *   report wall time statistics and the user/system CPU time of the shell
+ *   and its children. Runs that end with a non-zero status are counted and
+ *   reported.
+ *   Usage: bench [-n runs] [-w warmup] cmd args...
+ * Parameters: *arg: the whole input line, terminated with '\n'.
+ * Return: 0 on success, 1 if some measured run failed, -1 on usage or
+ *   syntax error.
+ */
+int shell_bench(char *arg)
+{
+  int runs = BENCH_RUNS;
+  int warmup = BENCH_WARMUP;
+  char *p = arg + strlen("bench");
+  
+  /* Parse options; whatever follows them is the command line */
+  for (;;) {
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p != '-' || (p[1] != 'n' && p[1] != 'w') || (p[2] != ' ' && p[2] != '\t'))
+      break;
+    char opt = p[1];
+    char *end;
+    long val = strtol(p + 3, &end, 10);
+    if (end == p + 3 || val < 0 || val > INT_MAX || (opt == 'n' && val == 0)) {
+      fprintf(stderr, "usage: bench [-n runs] [-w warmup] cmd args...\n");
+      return -1;
+    }
+    if (opt == 'n')
+      runs = (int)val;
+    else
+      warmup = (int)val;
+    p = end;
+  }
+  if (*p == '\0' || *p == '\n') {
+    fprintf(stderr, "usage: bench [-n runs] [-w warmup] cmd args...\n");
+    return -1;
+  }
+  
+  size_t cmdlen = strlen(p);
+  char *buf = malloc(cmdlen + 1); // handle_line modifies its input, so each run gets a fresh copy
+  double *wall = malloc(runs * sizeof(double));
+  if (buf == NULL || wall == NULL) {
+    perror("run_shell: bench");
+    free(buf);
+    free(wall);
+    return -1;
+  }
+  
+  int i;
+  for (i = 0; i < warmup; i++) {
+    memcpy(buf, p, cmdlen + 1);
+    if (handle_line(buf)) {
+      fprintf(stderr, "run_shell: syntax error\n");
+      free(buf);
+      free(wall);
+      return -1;
+    }
+  }
+  
+  struct rusage self_start, self_end, ru_start, ru_end;
+  double user = 0, sys = 0;
+  int failed = 0, fail_status = 0;
+  for (i = 0; i < runs; i++) {
+    struct timespec t_start, t_end;
+    memcpy(buf, p, cmdlen + 1);
+    getrusage(RUSAGE_SELF, &self_start); // builtins and loops run in the shell itself
+    getrusage(RUSAGE_CHILDREN, &ru_start);
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    int ret = handle_line(buf);
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    getrusage(RUSAGE_CHILDREN, &ru_end);
+    getrusage(RUSAGE_SELF, &self_end);
+    if (ret) {
+      fprintf(stderr, "run_shell: syntax error\n");
+      free(buf);
+      free(wall);
+      return -1;
+    }
+    if (last_status) {
+      failed++;
+      fail_status = last_status;
+    }
+    wall[i] = elapsed_ms(&t_start, &t_end);
+    cpu_ms(&self_start, &self_end, &user, &sys);
+    cpu_ms(&ru_start, &ru_end, &user, &sys);
+  }
+  
+  /* Mean and sample standard deviation */
+  double mean = 0, var = 0;
+  for (i = 0; i < runs; i++)
+    mean += wall[i];
+  mean /= runs;
+  for (i = 0; i < runs; i++)
+    var += (wall[i] - mean) * (wall[i] - mean);
+  double stddev = runs > 1 ? sqrt(var / (runs - 1)) : 0;
+  double half = t_critical(runs - 1) * stddev / sqrt(runs); // half width of the 95% confidence interval
+  
+  qsort(wall, runs, sizeof(double), cmp_double);
+  
+  p[strcspn(p, "\n")] = '\0';
+  printf("bench: %d runs (%d warmup) of '%s'\n", runs, warmup, p);
+  printf("  wall ms: min %.3f  median %.3f  mean %.3f  p95 %.3f  p99 %.3f\n",
+         wall[0], (runs % 2) ? wall[runs / 2] : (wall[runs / 2 - 1] + wall[runs / 2]) / 2,
+         mean, percentile(wall, runs, 95), percentile(wall, runs, 99));
+  printf("  mean 95%% CI: [%.3f, %.3f] ms  (stddev %.3f ms)\n", mean - half, mean + half, stddev);
+  printf("  cpu ms/run: user %.3f  sys %.3f  (shell and children)\n", user / runs, sys / runs);
+  if (failed)
+    printf("  %d of %d runs failed (last status %d)\n", failed, runs, fail_status);
+  
+  free(buf);
+  free(wall);
+  return failed ? 1 : 0;
+}
+
 /* Function name: shell_cd
  * Description: like shell's cd command.
  * Parameters: *arg: arguments from input.
@@ -218,6 +439,13 @@ int shell_cd(char *arg)
   char buf[BUFSIZE + 1];
   memset(buf, 0, BUFSIZE + 1);
   
+  if(argnum < 2){ // a bare cd goes home
+    if((args[1] = getenv("HOME")) == NULL){
+      fprintf(stderr, "usage: cd dir\n");
+      return -1;
+    }
+  }
+  
   if(args[1][0] != '/' && args[1][0] != '.'){
     //char *getcwd(char *buf, size_t size);  get current working directory
     if(getcwd(buf, BUFSIZE) == NULL){
@@ -235,6 +463,7 @@ int shell_cd(char *arg)
   if(chdir(buf) == -1){
     fprintf(stderr, "%s:%d: chdir failed: %s\n", __FILE__,
             __LINE__, strerror(errno));
+    return -1;
   }
   return 0;
 }
@@ -307,74 +536,47 @@ int read_char(char *str)
 }
 
 /*  Function name: handle_line
- *  Description: Attempt to run a command
+ *  Description: Attempt to run a command line
  *  Parameters:
  *    line: character pointer to the user's input, terminated with '\n'.
  *  Return:
  *    Returns 0 on success, 1 on syntax error.
  *  Error handling:
- *    Returns 1 on syntax error.
+ *    Returns 1 if parse_program finds a syntax error. Errors found while running
+ *    (such as a misplaced redirection) are printed by the executor.
+ */
+int handle_line(char *line)
+{
+  struct program prog;
+  if (parse_program(line, &prog))
+    return 1;
+  
+  exec_program(&prog);
+  free_program(&prog);
+  return 0;
+}
+
+/*  Function name: run_commands
+ *  Description: Run a parsed pipeline, connecting the commands with pipes
+ *  Parameters:
+ *    commands: array of command structs, as built by exec_pipeline.
+ *    nchunks: number of commands in the pipeline.
+ *  Return:
+ *    Returns 0 on success, 1 on syntax error.
+ *  Error handling:
  *    If open() returns -1, an error is printed. If the error is ENOENT (file not
  *    found), then the program is exited. Otherwise 1 is returned (syntax error).
  *    If pipe() returns -1, an error is printed, and the program is exited.
  *    If start_prog returns 1, a syntax error has occurred, and we return 1 to main().
  */
-int handle_line(char *line)
+int run_commands(struct command *commands, int nchunks)
 {
-  /* Remove \n from end of line */
-  char *line_ptr = line;
-  for ( ; *line_ptr != '\n'; line_ptr++);
-  *line_ptr = '\0';
-  
-  /* Calculate the number of sections separated by pipes in input. */
-  int nchunks = 1; // Number of sections
   int i;
-  for (i = 0; i < strlen(line); i++) {
-    if (line[i] == '|' && (i != 0 && i != strlen(line) - 1))
-      nchunks++;
-    else if (line[i] == '|' && (i == 0 || i == strlen(line) - 1)) // Syntax error occurs when '|' appears at the start or end of command.
-      return 1;
-  }
-  
-  /* Construct array of command structs */
-  
-  struct command *commands = malloc(nchunks * sizeof(struct command));
-  int cur_chunk;
-  for (cur_chunk = 0; cur_chunk < nchunks; cur_chunk++) {
-    char *chunk;  // Buffer of chars for the current chunk
-    if (cur_chunk == 0)
-      chunk = strtok(line, "|"); // For the first section, pointer points to start of line. Split line with '|'.
-    else
-      chunk = strtok(NULL, "|"); // For the subsequent sections, pointer points to the last splitted section. Split remaining part with '|'.
-    
-    /* Count the number of tokens in chunk */
-    char *ptr = chunk;
-    char last = ' ';
-    int toks = 1;
-    while (*ptr) {
-      if (isspace(*ptr) && !isspace(last))
-        toks++;
-      last = *ptr;
-      ptr++;
-    }
-    if (isspace(last))
-      toks--;
-    
-    /* Initialize our command struct for the current chunk */
-    commands[cur_chunk].argv = malloc((toks + 1) * sizeof(char *));
-    commands[cur_chunk].argc = toks;
-    
-    /* Tokenize the chunk (split by space) */
-    tokenize(chunk, commands[cur_chunk].argv, commands[cur_chunk].argc);
-  }
   
   /* If there is no pipe, just run it */
   if (nchunks == 1) {
     /* int start_prog(int pipeno, int numpipes, char *progname, int argc, char *argv[], int fd_in, int fd_out) */
-    int ret = start_prog(0, 1, commands[0].argv[0], commands[0].argc, commands[0].argv, 0, 1);
-    free_commands(commands, nchunks);
-    free(commands);
-    return ret;
+    return start_prog(0, 1, commands[0].argv[0], commands[0].argc, commands[0].argv, 0, 1);
   }
   
   int p1[2];   // Pipe for parent
@@ -384,11 +586,8 @@ int handle_line(char *line)
     perror("run_shell: handle_line");
   
   /* Get started from stdin, stdin --> p1[1] */
-  if (start_prog(0, nchunks, commands[0].argv[0], commands[0].argc, commands[0].argv, 0, p1[1])) {
-    free_commands(commands, nchunks);
-    free(commands);
+  if (start_prog(0, nchunks, commands[0].argv[0], commands[0].argc, commands[0].argv, 0, p1[1]))
     return 1;
-  }
   close_pipe(p1[1]);
   
   /* multiple pipes */
@@ -399,21 +598,15 @@ int handle_line(char *line)
     if (i % 2) { // p1[0] --> p2[1];
       if (pipe(p2))
         perror("run_shell: handle_line");
-      if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p1[0], p2[1])) {
-        free_commands(commands, nchunks);
-        free(commands);
+      if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p1[0], p2[1]))
         return 1;
-      }
       close_pipe(p1[0]);
       close_pipe(p2[1]);
     } else { // p2[0] --> p1[1];
       if (pipe(p1))
         perror("run_shell: handle_line");
-      if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p2[0], p1[1])) {
-        free_commands(commands, nchunks);
-        free(commands);
+      if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p2[0], p1[1]))
         return 1;
-      }
       close_pipe(p2[0]);
       close_pipe(p1[1]);
     }
@@ -421,25 +614,15 @@ int handle_line(char *line)
   
   /* Finish on stdout */
   if (i % 2) { // p1[0] --> stdout
-    if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p1[0], 1)) {
-      free_commands(commands, nchunks);
-      free(commands);
+    if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p1[0], 1))
       return 1;
-    }
     close_pipe(p1[0]);
   } else { // p2[0] --> stdout?
-    if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p2[0], 1)) {
-      free_commands(commands, nchunks);
-      free(commands);
+    if (start_prog(i, nchunks, commands[i].argv[0], commands[i].argc, commands[i].argv, p2[0], 1))
       return 1;
-    }
     close_pipe(p2[0]);
   }
   
-  /* Free every command struct in commands */
-  free_commands(commands, nchunks);
-  free(commands);
-  
   return 0;
 }
 
@@ -458,6 +641,7 @@ int handle_line(char *line)
  *   1 on syntax error
  * Error handling:
  *   Prints out a message if the progname is not found on the path (run_child() returns -1).
+ *   Files opened for redirection are closed once the child has been started.
  *   If waitpid returns with an error (-1), a message is printed, and the program is exited.
  */
 int start_prog(int pipeno, int numpipes, char *progname, int argc, char *argv[], int fd_in, int fd_out)
@@ -469,19 +653,17 @@ int start_prog(int pipeno, int numpipes, char *progname, int argc, char *argv[],
   /* Find out if there's File I/O */
   int flags;                    // Flags for open()
   int mode = S_IRUSR | S_IWUSR; // Mode for open()
-  int i;
+  int files[2] = { -1, -1 };    // Files opened for '<' and '>', closed once the child has them
+  int i, err = 0;
   for (i = 0; i < argc; i++) {
     if (!strcmp(argv[i], ">") || !strcmp(argv[i], "<")) { // if the argument is '>' or '<'.
-      /* Check syntax error -- redirection where innappropriate */
-      if (numpipes > 1) {
-        if (!strcmp(argv[i], ">") && pipeno + 1 < numpipes)
-          return 1;
-        if (!strcmp(argv[i], "<") && pipeno != 0)
-          return 1;
+      int writing = argv[i][0] == '>';
+      /* Check syntax error -- redirection where innappropriate, or no file given */
+      if ((numpipes > 1 && ((writing && pipeno + 1 < numpipes) || (!writing && pipeno != 0)))
+          || i + 1 >= argc) {
+        err = 1;
+        break;
       }
-      /* Check syntax error -- no file given */
-      if (i >= argc)
-        return 1;
       
       flags = (!strcmp(argv[i], ">")) ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY; // O_WRONLY: write only; O_CREAT: creat the file; O_TRUNC: clear file; O_RDONLY: read only.
       int fd_tmp = open(argv[i+1], flags, mode); // int open(const char *pathname, int flags, mode_t mode); return fd on success, -1 on error.
@@ -490,43 +672,73 @@ int start_prog(int pipeno, int numpipes, char *progname, int argc, char *argv[],
         perror("run_shell: start_prog");
         if (errno != ENOENT) /* Consider ENOENT (file not found) a syntax error */
           exit(EXIT_FAILURE);
-        return 1;
+        err = 1;
+        break;
+      }
+      if (files[writing] >= 0) // a second '<' or '>' replaces the first
+        close_pipe(files[writing]);
+      files[writing] = fd_tmp;
+      fd_in = writing ? fd_in : fd_tmp; // choose fd_in and fd_out by the direction.
+      fd_out = writing ? fd_tmp : fd_out;
+      argv[i] = NULL;
+    } else if ((!strncmp(argv[i], ">&", 2) || !strncmp(argv[i], "<&", 2)) && argv[i][2]) { // '>&NAME' or '<&NAME': talk to a coprocess.
+      int writing = argv[i][0] == '>';
+      /* Check syntax error -- redirection where innappropriate */
+      if (numpipes > 1 && ((writing && pipeno + 1 < numpipes) || (!writing && pipeno != 0))) {
+        err = 1;
+        break;
+      }
+      int fd_tmp = coproc_fd(argv[i] + 2, writing); // owned by the coprocess, never closed here
+      if (fd_tmp < 0) {
+        fprintf(stderr, "run_shell: no coprocess %s\n", argv[i] + 2);
+        err = 1;
+        break;
       }
-      fd_in = (!strcmp(argv[i], "<")) ? fd_tmp : fd_in; // choose fd_in and fd_out by the direction.
-      fd_out = (!strcmp(argv[i], ">")) ? fd_tmp : fd_out;
+      fd_in = writing ? fd_in : fd_tmp;
+      fd_out = writing ? fd_tmp : fd_out;
       argv[i] = NULL;
     }
   }
   
   /* Run in background if requested */
-  if (!strcmp(argv[argc-1], "&")) {
+  if (!err && argv[argc-1] && !strcmp(argv[argc-1], "&")) {
     argv[argc-1] = NULL;
-    if ((child_pid = run_child(progname, argv, fd_in, fd_out, 2)) < 0) {
+    int fd_err = 2;
+    int job = joblog_open(argv, &fd_out, &fd_err); // Record the job's output if joblog is on
+    if ((child_pid = run_child(progname, argv, fd_in, fd_out, fd_err)) < 0) {
       /* error */
       perror("Command not found on the path");
       child_pid = -127;
     }
-  } else {
+    joblog_started(job, child_pid);
+    last_status = child_pid < 0 ? 127 : 0;
+  } else if (!err) {
     child_pid = run_child(progname, argv, fd_in, fd_out, 2);
     if (child_pid < 0) {
       /* run_child returned error */
       perror("Command not found on the path");
+      last_status = 127;
     } else {
       int status;
       if (waitpid(child_pid, &status, 0) < 0) {
         /* Error -- check if control-c was sent */
-        if (errno == EINTR) {
-          printf("Exiting process %d\n", child_pid);
-          return 0;
+        if (errno != EINTR) {
+          perror("run_shell: handle_line");
+          exit(EXIT_FAILURE);
         }
-        perror("run_shell: handle_line");
-        exit(EXIT_FAILURE);
+        printf("Exiting process %d\n", child_pid);
+      } else {
+        last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status); // Exit status, as $?
+        child_pid = -127;
       }
-      child_pid = -127;
     }
   }
   
-  return 0;
+  /* The child has its own copies of the redirected files */
+  for (i = 0; i < 2; i++)
+    if (files[i] >= 0)
+      close_pipe(files[i]);
+  return err;
 }
 
 /* Function name: close_pipe
@@ -548,20 +760,6 @@ void close_pipe(int fd)
   }
 }
 
-/* Function name: free_commands
- * Description: Frees all command structs in an array.
- * Parameter:
- *   *cmds: Command struct array to free.
- *   len: Length of the array.
- */
-void free_commands(struct command *cmds, int len)
-{
-  int i;
-  for (i = 0; i < len; i++) {
-    free(cmds[i].argv);
-  }
-}
-
 /* Function name: sigtstp_handler
  * Description: Signal handler for SIGTSTP
  * Parameter:
@@ -17,15 +17,18 @@ int gethostname (char *name, size_t len);
 int kill (pid_t pid, int signo);
 int read_char(char *str);  
 int parse_args(char *args[], char *arg);  
+int shell_about();
+int shell_bench(char *arg);
 int shell_cd(char *args);
 int shell_clear();
 int shell_dir(char *arg);
 int shell_env();
 int shell_help();
+int is_line_builtin(const char *line);
+int run_line(char *line);
 int handle_line (char *line);
+int run_commands(struct command *commands, int nchunks);
 int start_prog (int pipeno, int numpipes, char *progname, int argc, char *argv[], int fd_in, int fd_out );
 void close_pipe (int fd);
-void free_commands (struct command *cmds, int len);
-static void sigtstp_handler (int signo);
 
 #endif /* myshell_h */
@@ -4,19 +4,71 @@
  *  Date: 04/09/2017
  */
 
+#define _GNU_SOURCE
+
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/sched.h>
+#endif
 
 #include "util.h"
 
 #define RC_CHECK(s) if(!(s)) run_child_error();
 
+struct child_limits *child_limits = NULL;
+
 void run_child_error();
+static pid_t spawn(void);
+static void enter_limits(void);
+
+/* Function name: parse_size
+ * Description: parse a size with an optional K, M or G suffix.
+ * Parameters:
+ *   text: the size.
+ * Return:
+ *   the size in bytes, or 0 if the text is not a size.
+ */
+size_t parse_size(const char *text)
+{
+  char *end;
+  unsigned long long val = strtoull(text, &end, 10);
+  if (end == text)
+    return 0;
+  switch (*end) {
+  case 'k': case 'K': val <<= 10; end++; break;
+  case 'm': case 'M': val <<= 20; end++; break;
+  case 'g': case 'G': val <<= 30; end++; break;
+  }
+  return *end ? 0 : (size_t)val;
+}
+
+/* Function name: write_all
+ * Description: write a whole buffer, retrying short writes.
+ * Return: 0 on success, -1 on error (errno is set).
+ */
+int write_all(int fd, const char *data, size_t len)
+{
+  while(len > 0)
+  { ssize_t n = write(fd, data, len);
+
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return -1;
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
 
 /* Function name: tokenize
  * Description: split a data buffer by spaces.
@@ -74,11 +126,14 @@ pid_t run_child(char *progname, char *argv[], int child_stdin, int child_stdout,
   
   /* fork() return child process id if in parent process, return 0 if in child process, return -1 on error */
   /* 2 error types: reach the limit of number of processes; lack of memory */
-  if((child = fork()))
+  if((child = spawn()))
   { /* in parent or on error */
     return child;
   }
 
+  enter_limits(); // Join the cgroup and set resource limits, if any
+  signal(SIGPIPE, SIG_DFL); // The shell ignores SIGPIPE; programs expect the default
+
   /* Set up file descriptors */
   
   /* First, duplicate the provided file descriptors to 0, 1, 2 */
@@ -130,3 +185,63 @@ void run_child_error()
   else
     exit(1); /* Always return someting negative */
 }
+
+/* Function name: spawn
+ * Description: fork, starting the child directly in the cgroup of child_limits
+ *   if there is one and the kernel supports clone3(CLONE_INTO_CGROUP). If
+ *   clone3 fails, this falls back to fork() and enter_limits moves the child.
+ * Return:
+ *   like fork().
+ */
+static pid_t spawn(void)
+{
+#if defined(SYS_clone3) && defined(CLONE_INTO_CGROUP)
+  static int have_clone3 = 1; // cleared once the kernel turns clone3 down
+  if(child_limits && child_limits->cgroup_fd >= 0 && have_clone3)
+  { struct clone_args args;
+    pid_t child;
+
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_INTO_CGROUP;
+    args.exit_signal = SIGCHLD;
+    args.cgroup = child_limits->cgroup_fd;
+    child = syscall(SYS_clone3, &args, sizeof(args));
+    if(child == 0)
+      child_limits->cgroup_fd = -1; // Already in place, enter_limits has nothing to move
+    if(child >= 0)
+      return child;
+    if(errno == ENOSYS || errno == EINVAL || errno == E2BIG)
+      have_clone3 = 0; // Older kernel: fork and move the child by hand from now on
+    /* Otherwise the group refused the child (e.g. EACCES, EBUSY): fork anyway, so
+     * the child's own write to cgroup.procs reports the real error */
+  }
+#endif
+  return fork();
+}
+
+/* Function name: enter_limits
+ * Description: in the child, join the cgroup of child_limits (unless spawn
+ *   already did) and set its resource limits.
+ */
+static void enter_limits(void)
+{
+  struct rlimit lim;
+  char pid[32];
+
+  if(!child_limits)
+    return;
+
+  if(child_limits->cgroup_fd >= 0)
+  { int fd = openat(child_limits->cgroup_fd, "cgroup.procs", O_WRONLY);
+    int len = snprintf(pid, sizeof(pid), "%ld\n", (long)getpid());
+
+    RC_CHECK(fd >= 0);
+    RC_CHECK(write(fd, pid, len) == len);
+    close(fd);
+  }
+
+  if(child_limits->mem != RLIM_INFINITY)
+  { lim.rlim_cur = lim.rlim_max = child_limits->mem;
+    RC_CHECK(setrlimit(RLIMIT_AS, &lim) == 0);
+  }
+}
@@ -7,8 +7,18 @@
 #ifndef util_h
 #define util_h
 
+#include <sys/resource.h>
 #include <sys/types.h>
 
+/* Limits that run_child applies to every child it spawns (see limit.c) */
+struct child_limits {
+  int cgroup_fd;  /* directory of the cgroup v2 group to spawn into, or -1 */
+  rlim_t mem;     /* RLIMIT_AS of the child, or RLIM_INFINITY */
+};
+
+/* Limits for run_child, NULL when children run unlimited */
+extern struct child_limits *child_limits;
+
 /* Function name: tokenize
  * Description: Tokenize a buffer of data.
  *   The buffer is split into tokens by whitespace. The pointers to the tokens
@@ -26,6 +36,23 @@
  */
 int tokenize(char *buffer, char *argv[], int maxargs);
 
+/* Function name: parse_size
+ * Description: Parse a size such as "512", "64K", "2M" or "1G".
+ * Parameters:
+ *   text, the size, with an optional K, M or G suffix (powers of 1024).
+ * Output:
+ *   Returns the size in bytes, or 0 if text is not a size.
+ */
+size_t parse_size(const char *text);
+
+/* Function name: write_all
+ * Description: Write a whole buffer to a file descriptor, retrying short
+ *   writes and EINTR.
+ * Output:
+ *   Returns 0 on success, -1 on error (errno is set, e.g. EPIPE).
+ */
+int write_all(int fd, const char *data, size_t len);
+
 /* Function name: run_child
  * Description: Spawn a child process.
  * Parameters:
@@ -36,6 +63,9 @@ int tokenize(char *buffer, char *argv[], int maxargs);
  *   child_stdin, file descriptor to be provided to child as stdin
  *   child_stdout, file descriptor to be provided to child as stdout
  *   child_stderr, file descriptor to be provided to child as stderr
+ *   If child_limits is set, the child is started in its cgroup (with
+ *   clone3(CLONE_INTO_CGROUP) where the kernel has it, otherwise by writing
+ *   its PID to cgroup.procs) and gets its resource limits.
  * Output:
  *   Returns the PID of the child or -1 if fork() returned an error.
  * Error handling: